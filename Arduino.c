@@ -8,15 +8,49 @@
 #include <stdint.h>
 #include "Arduino.h"
 
-#ifdef BITBANG
+#if BITBANG
 uint8_t u8SDA_Pin, u8SCL_Pin;
-int iDelay = 1;
+static PINHANDLE phSDA, phSCL;
 #endif
 
 void delay(int i)
 {
 	Delay_Ms(i);
 }
+
+//
+// SysTick is the time base of the driver's statistics and timeouts.
+// Delay_Us()/Delay_Ms() expect it to run at HCLK/8 (their CMP values
+// assume SystemCoreClock/8000000 ticks per microsecond) and leave it
+// stopped and counting down, so it's only restarted here; writing CTLR
+// would make every later delay run short.
+//
+uint64_t SysTick_Read(void)
+{
+	if (!(SysTick->CTLR & 1))
+		SysTick->CTLR |= 1; // enable, keep STCLK and MODE
+	return SysTick->CNT;
+} /* SysTick_Read() */
+
+//
+// Ticks since u64Start in whichever direction SysTick counts
+//
+uint64_t SysTick_Elapsed(uint64_t u64Start)
+{
+	uint64_t u64Now = SysTick_Read();
+
+	if (SysTick->CTLR & 0x10) // counting down
+		return u64Start - u64Now;
+	return u64Now - u64Start;
+} /* SysTick_Elapsed() */
+
+//
+// SysTick rate from its clock source bit (HCLK or HCLK/8)
+//
+uint32_t SysTick_Hz(void)
+{
+	return (SysTick->CTLR & 4) ? SystemCoreClock : SystemCoreClock / 8;
+} /* SysTick_Hz() */
 // Arduino-like API defines and function wrappers for WCH MCUs
 
 void pinMode(uint8_t u8Pin, int iMode)
@@ -33,6 +67,8 @@ void pinMode(uint8_t u8Pin, int iMode)
     	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IPU;
     else if (iMode == INPUT_PULLDOWN)
     	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IPD;
+    else if (iMode == OUTPUT_OPEN_DRAIN)
+    	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_OD;
     GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
     switch (u8Pin & 0xf0) {
     case 0xa0:
@@ -95,6 +131,36 @@ void digitalWrite(uint8_t u8Pin, uint8_t u8Value)
 		break;
 	}
 } /* digitalWrite() */
+
+//
+// Look up the port registers and bit of a pin for the pinSet/pinClear/
+// pinRead inline functions. Returns 0 for success, -1 for an invalid pin
+// (the handle then points to a dummy port)
+//
+int pinGetHandle(uint8_t u8Pin, PINHANDLE *pHandle)
+{
+	static GPIO_TypeDef dummyPort;
+
+	pHandle->u16Mask = GPIO_Pin_0 << (u8Pin & 0xf);
+	switch (u8Pin & 0xf0) {
+	case 0xa0:
+		pHandle->pPort = GPIOA;
+		break;
+	case 0xb0:
+		pHandle->pPort = GPIOB;
+		break;
+	case 0xc0:
+		pHandle->pPort = GPIOC;
+		break;
+	case 0xd0:
+		pHandle->pPort = GPIOD;
+		break;
+	default:
+		pHandle->pPort = &dummyPort;
+		return -1;
+	}
+	return 0;
+} /* pinGetHandle() */
 //
 // Initialize USART1
 //
@@ -121,11 +187,225 @@ void UART_Init(int iBaud)
 //    USART_HalfDuplexCmd(USART1, ENABLE);
 } /* UART_Init() */
 
+//
+// USART1 receive ring buffer
+// DMA1 channel 5 copies each received byte into the buffer in circular
+// mode, so nothing is lost while the CPU is busy drawing or sitting in
+// another interrupt. The transfer complete interrupt counts the laps
+// around the buffer; together with the DMA position that gives the total
+// number of bytes received, and the reader keeps its own total. When
+// the writer gets more than a buffer ahead, the oldest bytes have been
+// overwritten: they are counted as overruns and skipped.
+//
+static uint8_t *pRxBuf; // NULL = polled mode
+static uint32_t u32RxSize;
+static volatile uint32_t u32RxLaps;
+static uint32_t u32RxTail; // total bytes consumed (wraps at 2^32)
+static uint32_t u32RxPos; // index of the next byte to read
+static UARTSTATS uartStats;
+
+void DMA1_Channel5_IRQHandler(void) __attribute__((interrupt));
+
+void DMA1_Channel5_IRQHandler(void)
+{
+	if (DMA_GetITStatus(DMA1_IT_TC5)) {
+		DMA_ClearITPendingBit(DMA1_IT_TC5);
+		u32RxLaps++;
+	}
+} /* DMA1_Channel5_IRQHandler() */
+
+//
+// Total number of bytes written by the DMA (wraps at 2^32)
+//
+static uint32_t uartRxHead(void)
+{
+	uint32_t u32Laps, u32Count;
+
+	__disable_irq();
+	u32Count = DMA1_Channel5->CNTR;
+	u32Laps = u32RxLaps;
+	if (DMA_GetITStatus(DMA1_IT_TC5)) { // wrapped but the interrupt hasn't run yet
+		u32Count = DMA1_Channel5->CNTR; // position after the wrap
+		u32Laps++;
+	}
+	__enable_irq();
+	return u32Laps * u32RxSize + (u32RxSize - u32Count);
+} /* uartRxHead() */
+
+static void uartRxSkip(uint32_t u32Count)
+{
+	u32RxTail += u32Count;
+	u32RxPos = (u32RxPos + u32Count) % u32RxSize;
+} /* uartRxSkip() */
+
+//
+// Number of unread bytes in the ring buffer; drops the overwritten ones
+//
+int UART_Available(void)
+{
+	uint32_t u32Avail;
+
+	if (pRxBuf == NULL)
+		return (USART_GetFlagStatus(USART1, USART_FLAG_RXNE) == SET);
+	u32Avail = uartRxHead() - u32RxTail;
+	if (u32Avail > u32RxSize) { // the writer lapped us
+		uartStats.u32Overruns++;
+		uartStats.u32BytesLost += u32Avail - u32RxSize;
+		uartRxSkip(u32Avail - u32RxSize);
+		u32Avail = u32RxSize;
+	}
+	return (int)u32Avail;
+} /* UART_Available() */
+
+//
+// Switch USART1 (after UART_Init) to DMA reception into pBuffer
+// Returns 0 for success, -1 for bad parameters
+//
+int UART_BeginRx(uint8_t *pBuffer, int iSize)
+{
+    DMA_InitTypeDef DMA_InitStructure = {0};
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+    if (pBuffer == NULL || iSize < 2) return -1;
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    DMA_Cmd(DMA1_Channel5, DISABLE);
+    DMA_DeInit(DMA1_Channel5);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uintptr_t)&USART1->DATAR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uintptr_t)pBuffer;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = iSize;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA1_Channel5, &DMA_InitStructure);
+    DMA_ClearITPendingBit(DMA1_IT_TC5);
+
+    pRxBuf = pBuffer;
+    u32RxSize = (uint32_t)iSize;
+    u32RxLaps = u32RxTail = u32RxPos = 0;
+    memset(&uartStats, 0, sizeof(uartStats));
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel5_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0; // only counts laps
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_Init(&NVIC_InitStructure);
+    NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+    DMA_ITConfig(DMA1_Channel5, DMA_IT_TC, ENABLE);
+    DMA_Cmd(DMA1_Channel5, ENABLE);
+    USART_DMACmd(USART1, USART_DMAReq_Rx, ENABLE);
+    return 0;
+} /* UART_BeginRx() */
+
 void UART_DeInit(void)
 {
+	if (pRxBuf) {
+		USART_DMACmd(USART1, USART_DMAReq_Rx, DISABLE);
+		DMA_Cmd(DMA1_Channel5, DISABLE);
+		NVIC_DisableIRQ(DMA1_Channel5_IRQn);
+		pRxBuf = NULL;
+	}
 	USART_DeInit(USART1);
 } /* UART_DeInit() */
 
+//
+// Non-blocking reads from the ring buffer
+// UART_ReadByte() and UART_Peek() return -1 when it's empty
+//
+int UART_ReadByte(void)
+{
+	int c;
+
+	if (pRxBuf == NULL) {
+		if (USART_GetFlagStatus(USART1, USART_FLAG_RXNE) == RESET)
+			return -1;
+		return USART_ReceiveData(USART1);
+	}
+	if (UART_Available() == 0)
+		return -1;
+	c = pRxBuf[u32RxPos];
+	uartRxSkip(1);
+	uartStats.u32BytesRead++;
+	return c;
+} /* UART_ReadByte() */
+
+int UART_Peek(void)
+{
+	if (pRxBuf == NULL || UART_Available() == 0)
+		return -1;
+	return pRxBuf[u32RxPos];
+} /* UART_Peek() */
+
+//
+// Copy up to iLen waiting bytes; returns the number copied
+//
+int UART_ReadBytes(uint8_t *pDest, int iLen)
+{
+	int iCount, iChunk, iTotal = 0;
+
+	if (pRxBuf == NULL) {
+		while (iTotal < iLen && (iCount = UART_ReadByte()) >= 0)
+			pDest[iTotal++] = (uint8_t)iCount;
+		return iTotal;
+	}
+	iCount = UART_Available();
+	if (iCount > iLen) iCount = iLen;
+	while (iCount) { // at most two pieces (before and after the wrap)
+		iChunk = (int)(u32RxSize - u32RxPos);
+		if (iChunk > iCount) iChunk = iCount;
+		memcpy(&pDest[iTotal], &pRxBuf[u32RxPos], iChunk);
+		uartRxSkip(iChunk);
+		iTotal += iChunk;
+		iCount -= iChunk;
+	}
+	uartStats.u32BytesRead += iTotal;
+	return iTotal;
+} /* UART_ReadBytes() */
+
+//
+// Read a complete line (ending in LF; a CR before it is removed too)
+// into szLine as a zero terminated string. Returns the length, or -1 if
+// no complete line has arrived yet (nothing is consumed then). A line
+// which doesn't fit in iMax-1 bytes is returned in pieces
+//
+int UART_ReadLine(char *szLine, int iMax)
+{
+	int i, iAvail, iLen, iEnd = -1;
+
+	if (pRxBuf == NULL || iMax < 2) return -1;
+	iAvail = UART_Available();
+	for (i=0; i<iAvail && i<iMax-1; i++) {
+		if (pRxBuf[(u32RxPos + i) % u32RxSize] == '\n') {
+			iEnd = i;
+			break;
+		}
+	}
+	if (iEnd < 0) {
+		if (iAvail < iMax-1)
+			return -1; // wait for the rest
+		iLen = UART_ReadBytes((uint8_t *)szLine, iMax-1); // too long; return a piece
+	} else {
+		iLen = UART_ReadBytes((uint8_t *)szLine, iEnd);
+		UART_ReadByte(); // the LF
+		if (iLen && szLine[iLen-1] == '\r')
+			iLen--;
+	}
+	szLine[iLen] = 0;
+	return iLen;
+} /* UART_ReadLine() */
+
+void UART_GetStats(UARTSTATS *pStats)
+{
+	UART_Available(); // bring the overrun counters up to date
+	*pStats = uartStats;
+	if (pRxBuf)
+		pStats->u32BytesReceived = uartRxHead();
+} /* UART_GetStats() */
+
 //
 // Returns an 8-bit character (0-255)
 // or -1 to indicate a timeout
@@ -135,6 +415,11 @@ int UART_Read(void)
 uint8_t c;
 int iTimeout = 0;
 
+    if (pRxBuf) { // wait for the ring buffer instead of the register
+        while (UART_Available() == 0 && iTimeout < UART_TIMEOUT)
+            iTimeout++;
+        return UART_ReadByte();
+    }
     while(USART_GetFlagStatus(USART1, USART_FLAG_RXNE) == RESET && iTimeout < UART_TIMEOUT)
     {
         iTimeout++;
@@ -145,91 +430,169 @@ int iTimeout = 0;
     return c;
 } /* UART_Read() */
 
-#ifdef BITBANG
-uint8_t SDA_READ(void)
+#if BITBANG
+//
+// Bit-banged I2C master
+// SDA and SCL are open-drain outputs; writing a 1 releases the line to
+// the pull-up resistor and the input register reads back the real level,
+// so a slave holding SCL low (clock stretching) can be seen.
+// The half bit period is a busy loop whose length comes from
+// SystemCoreClock, the requested speed and the measured cost of one loop
+// pass, less the cycles spent toggling the pins themselves.
+//
+#define I2C_LOOP_CYCLES 4       // cycles per delay loop pass if it can't be measured
+#define I2C_EDGE_CYCLES 12      // call + register write overhead of each half period
+#define I2C_STRETCH_US 10000    // longest clock stretch before giving up
+
+static uint32_t u32LoopCycles = I2C_LOOP_CYCLES;
+static uint32_t u32HalfLoops; // delay loop passes per half bit period
+static uint32_t u32StretchLoops; // SCL polls before a stretch times out
+static int bI2CTimeout; // a slave held SCL low for too long
+static I2CSTATS i2cStats;
+
+static inline void SDA_HIGH(void)
 {
-	return digitalRead(u8SDA_Pin);
+	pinSet(&phSDA);
 }
-void SDA_HIGH(void)
+static inline void SDA_LOW(void)
 {
-	pinMode(u8SDA_Pin, INPUT);
+	pinClear(&phSDA);
 }
-void SDA_LOW(void)
+static inline uint8_t SDA_READ(void)
 {
-	pinMode(u8SDA_Pin, OUTPUT);
-	digitalWrite(u8SDA_Pin, 0);
+	return pinRead(&phSDA);
 }
-void SCL_HIGH(void)
+static inline void SCL_LOW(void)
 {
-	pinMode(u8SCL_Pin, INPUT);
+	pinClear(&phSCL);
 }
-void SCL_LOW(void)
+
+static void i2cDelayLoops(uint32_t u32Loops)
 {
-	pinMode(u8SCL_Pin, OUTPUT);
-	digitalWrite(u8SCL_Pin, 0);
-}
+	while (u32Loops--) {
+		__asm__ volatile ("" ::: "memory"); // keep the compiler from removing the loop
+	}
+} /* i2cDelayLoops() */
+
+static inline void i2cDelay(void)
+{
+	i2cDelayLoops(u32HalfLoops);
+} /* i2cDelay() */
+
+//
+// Release SCL and wait for it to really go high; a slave may hold
+// it low until it is ready (clock stretching)
+//
+static void SCL_HIGH(void)
+{
+	uint32_t u32Count;
+
+	pinSet(&phSCL);
+	if (pinRead(&phSCL)) return; // the usual case
+	i2cStats.u32Stretches++;
+	for (u32Count = 0; u32Count < u32StretchLoops; u32Count++) {
+		if (pinRead(&phSCL)) return;
+	}
+	bI2CTimeout = 1;
+	i2cStats.u32Timeouts++;
+} /* SCL_HIGH() */
+
+static void i2cCalibrate(void)
+{
+	uint64_t u64Start;
+	uint32_t u32Cycles;
+
+	u64Start = SysTick_Read();
+	i2cDelayLoops(1000);
+	// SysTick counts HCLK/8 (or HCLK if the application chose it)
+	u32Cycles = (uint32_t)SysTick_Elapsed(u64Start) * (SystemCoreClock / SysTick_Hz());
+	if (u32Cycles >= 1000 && u32Cycles < 64000) // a sane rate
+		u32LoopCycles = (u32Cycles + 500) / 1000;
+	else
+		u32LoopCycles = I2C_LOOP_CYCLES; // no usable timer; use the typical value
+} /* i2cCalibrate() */
+
 void I2CSetSpeed(int iSpeed)
 {
-	if (iSpeed >= 400000) iDelay = 1;
-	else if (iSpeed >= 100000) iDelay = 10;
-	else iDelay = 20;
-}
+	uint32_t u32HalfCycles;
+
+	if (iSpeed <= 0) iSpeed = 100000;
+	u32HalfCycles = SystemCoreClock / (2 * (uint32_t)iSpeed);
+	u32HalfLoops = (u32HalfCycles > I2C_EDGE_CYCLES) ? (u32HalfCycles - I2C_EDGE_CYCLES) / u32LoopCycles : 0;
+	u32StretchLoops = (SystemCoreClock / 1000000) * I2C_STRETCH_US / (u32LoopCycles + I2C_EDGE_CYCLES);
+	i2cStats.u32Speed = (uint32_t)iSpeed;
+} /* I2CSetSpeed() */
+
 void I2CInit(uint8_t u8SDA, uint8_t u8SCL, int iSpeed)
 {
 	u8SDA_Pin = u8SDA;
 	u8SCL_Pin = u8SCL;
-	if (iSpeed >= 400000) iDelay = 1;
-	else if (iSpeed >= 100000) iDelay = 10;
-	else iDelay = 20;
+	pinGetHandle(u8SDA, &phSDA);
+	pinGetHandle(u8SCL, &phSCL);
+	pinSet(&phSDA); // idle bus: both lines released
+	pinSet(&phSCL);
+	pinMode(u8SDA, OUTPUT_OPEN_DRAIN);
+	pinMode(u8SCL, OUTPUT_OPEN_DRAIN);
+	i2cCalibrate();
+	I2CSetSpeed(iSpeed);
+	I2CResetStats();
 } /* I2CInit() */
 
-void my_sleep_us(int iDelay)
+//
+// Bytes moved and time spent on the bus since I2CResetStats()
+//
+void I2CGetStats(I2CSTATS *pStats)
 {
-	Delay_Us(iDelay);
-}
+	*pStats = i2cStats;
+	pStats->u32BytesPerSec = 0;
+	if (i2cStats.u32Ticks)
+		pStats->u32BytesPerSec = (uint32_t)(((uint64_t)i2cStats.u32Bytes * SysTick_Hz()) / i2cStats.u32Ticks);
+} /* I2CGetStats() */
+
+void I2CResetStats(void)
+{
+	uint32_t u32Speed = i2cStats.u32Speed;
+
+	memset(&i2cStats, 0, sizeof(i2cStats));
+	i2cStats.u32Speed = u32Speed;
+} /* I2CResetStats() */
+
 // Transmit a byte and read the ack bit
 // if we get a NACK (negative acknowledge) return 0
 // otherwise return 1 for success
 //
-
-int i2cByteOut(uint8_t b)
+static int i2cByteOut(uint8_t b)
 {
 uint8_t i, ack;
 
 for (i=0; i<8; i++)
 {
-//    my_sleep_us(iDelay);
     if (b & 0x80)
       SDA_HIGH(); // set data line to 1
     else
       SDA_LOW(); // set data line to 0
     b <<= 1;
-//    my_sleep_us(iDelay);
+    i2cDelay();
     SCL_HIGH(); // clock high (slave latches data)
-    my_sleep_us(iDelay);
+    i2cDelay();
     SCL_LOW(); // clock low
-    my_sleep_us(iDelay);
 } // for i
-//my_sleep_us(iDelay);
 // read ack bit
 SDA_HIGH(); // set data line for reading
-//my_sleep_us(iDelay);
+i2cDelay();
 SCL_HIGH(); // clock line high
-my_sleep_us(iDelay); // DEBUG - delay/2
+i2cDelay();
 ack = SDA_READ();
-//my_sleep_us(iDelay);
 SCL_LOW(); // clock low
-my_sleep_us(iDelay); // DEBUG - delay/2
-SDA_LOW(); // data low
-return (ack == 0); // a low ACK bit means success
+i2cStats.u32Bytes++;
+return (ack == 0 && !bI2CTimeout); // a low ACK bit means success
 } /* i2cByteOut() */
 
 //
-// Receive a byte and read the ack bit
-// if we get a NACK (negative acknowledge) return 0
-// otherwise return 1 for success
+// Receive a byte and send the ack bit
+// (a NACK after the last byte tells the slave to stop)
 //
-uint8_t i2cByteIn(uint8_t bLast)
+static uint8_t i2cByteIn(uint8_t bLast)
 {
 uint8_t i;
 uint8_t b = 0;
@@ -237,9 +600,9 @@ uint8_t b = 0;
      SDA_HIGH(); // set data line as input
      for (i=0; i<8; i++)
      {
-         my_sleep_us(iDelay); // wait for data to settle
+         i2cDelay(); // wait for data to settle
          SCL_HIGH(); // clock high (slave latches data)
-         my_sleep_us(iDelay);
+         i2cDelay();
          b <<= 1;
          if (SDA_READ() != 0) // read the data bit
            b |= 1; // set data bit
@@ -249,50 +612,54 @@ uint8_t b = 0;
         SDA_HIGH(); // last byte sends a NACK
      else
         SDA_LOW();
-//     my_sleep_us(iDelay);
+     i2cDelay();
      SCL_HIGH(); // clock high
-     my_sleep_us(iDelay);
+     i2cDelay();
      SCL_LOW(); // clock low to send ack
-     my_sleep_us(iDelay);
-//     SDA_HIGH();
-     SDA_LOW(); // data low
+     i2cStats.u32Bytes++;
   return b;
 } /* i2cByteIn() */
 //
 // Send I2C STOP condition
 //
-void i2cEnd(void)
+static void i2cEnd(uint64_t u64Start)
 {
    SDA_LOW(); // data line low
-   my_sleep_us(iDelay);
+   i2cDelay();
    SCL_HIGH(); // clock high
-   my_sleep_us(iDelay);
+   i2cDelay();
    SDA_HIGH(); // data high
-   my_sleep_us(iDelay);
+   i2cDelay(); // bus free time before the next START
+   i2cStats.u32Ticks += (uint32_t)SysTick_Elapsed(u64Start);
 } /* i2cEnd() */
 
-int i2cBegin(uint8_t addr, uint8_t bRead)
+//
+// Send a START condition followed by the address byte
+// Returns the start time for i2cEnd()'s statistics in *pStart
+//
+static int i2cBegin(uint8_t addr, uint8_t bRead, uint64_t *pStart)
 {
-   int rc;
-//   SCL_HIGH();
-//   my_sleep_us(iDelay);
+   *pStart = SysTick_Read();
+   bI2CTimeout = 0;
+   SDA_HIGH(); // the bus should already be idle (both high)
+   SCL_HIGH();
+   i2cDelay();
    SDA_LOW(); // data line low first
-   my_sleep_us(iDelay);
+   i2cDelay();
    SCL_LOW(); // then clock line low is a START signal
    addr <<= 1;
    if (bRead)
       addr++; // set read bit
-   rc = i2cByteOut(addr); // send the slave address and R/W bit
-   return rc;
+   return i2cByteOut(addr); // send the slave address and R/W bit
 } /* i2cBegin() */
 
 void I2CWrite(uint8_t addr, uint8_t *pData, int iLen)
 {
 uint8_t b;
 int rc;
+uint64_t u64Start;
 
-   i2cBegin(addr, 0);
-   rc = 1;
+   rc = i2cBegin(addr, 0, &u64Start);
    while (iLen && rc == 1)
    {
       b = *pData++;
@@ -302,40 +669,464 @@ int rc;
          iLen--;
       }
    } // for each byte
-   i2cEnd();
-//return (rc == 1) ? (iOldLen - iLen) : 0; // 0 indicates bad ack from sending a byte
+   i2cEnd(u64Start);
 } /* I2CWrite() */
 
 void I2CRead(uint8_t addr, uint8_t *pData, int iLen)
 {
-   i2cBegin(addr, 1);
-   while (iLen--)
+uint64_t u64Start;
+
+   i2cBegin(addr, 1, &u64Start);
+   while (iLen-- && !bI2CTimeout)
    {
       *pData++ = i2cByteIn(iLen == 0);
    } // for each byte
-   i2cEnd();
+   i2cEnd(u64Start);
 } /* I2CRead() */
 
 int I2CTest(uint8_t addr)
 {
 int response = 0;
+uint64_t u64Start;
 
-   if (i2cBegin(addr, 0)) // try to write to the given address
+   if (i2cBegin(addr, 0, &u64Start)) // try to write to the given address
    {
       response = 1;
    }
-   i2cEnd();
+   i2cEnd(u64Start);
 return response;
 } /* I2CTest() */
 
+//
+// The transaction API works the same way as with the hardware I2C, but
+// each transaction is carried out (and its callback called) right away
+//
+int I2CSubmit(I2CTRANSACTION *pTrans)
+{
+int i, rc;
+uint64_t u64Start;
+
+   if (pTrans->iWriteLen || pTrans->iReadLen == 0) {
+      rc = i2cBegin(pTrans->u8Addr, 0, &u64Start);
+      for (i=0; i<pTrans->iWriteLen && rc; i++)
+         rc = i2cByteOut(pTrans->pWrite[i]);
+      if (rc && pTrans->iReadLen) { // repeated START, no STOP in between
+         SDA_HIGH();
+         i2cDelay();
+         SCL_HIGH();
+         i2cDelay();
+         SDA_LOW();
+         i2cDelay();
+         SCL_LOW();
+         rc = i2cByteOut((pTrans->u8Addr << 1) | 1);
+      }
+   } else {
+      rc = i2cBegin(pTrans->u8Addr, 1, &u64Start);
+   }
+   for (i=0; i<pTrans->iReadLen && rc && !bI2CTimeout; i++)
+      pTrans->pRead[i] = i2cByteIn(i == pTrans->iReadLen-1);
+   i2cEnd(u64Start);
+   if (bI2CTimeout)
+      pTrans->iStatus = I2C_STATUS_TIMEOUT;
+   else
+      pTrans->iStatus = (rc) ? I2C_STATUS_OK : I2C_STATUS_NACK;
+   if (pTrans->pfnDone)
+      (*pTrans->pfnDone)(pTrans);
+   return 0;
+} /* I2CSubmit() */
+
+void I2CService(void)
+{
+} /* I2CService() */
+
+int I2CWaitTransaction(I2CTRANSACTION *pTrans)
+{
+   return pTrans->iStatus;
+} /* I2CWaitTransaction() */
+
 #else // hardware I2C
+//
+// Interrupt driven I2C1 master
+// Transactions (a write, a read or a write followed by a read with a
+// repeated START) wait in a small queue and are worked through by the
+// event and error interrupts, so the caller can keep drawing. Each one
+// ends with a status and an optional callback (from interrupt context).
+// I2CService() (or I2CWaitTransaction) aborts a transaction which takes
+// longer than its timeout and resets the peripheral.
+//
+#define I2C_QUEUE_SIZE 8
+#define I2C_DEFAULT_TIMEOUT_US 20000
+#define I2C_RECOVER_PULSES 9 // enough to finish any byte a slave is sending
+#ifdef __CH32V20x_H
+#define I2C_SCL_PIN 0xb6
+#define I2C_SDA_PIN 0xb7
+#else
+#define I2C_SCL_PIN 0xc2
+#define I2C_SDA_PIN 0xc1
+#endif
+enum {
+	I2C_PHASE_WRITE = 0,
+	I2C_PHASE_READ
+};
+static I2CTRANSACTION *pI2CQueue[I2C_QUEUE_SIZE];
+static volatile int iI2CHead, iI2CTail;
+static I2CTRANSACTION * volatile pI2CActive;
+static int iI2CPhase, iI2CIndex;
+static uint64_t u64I2CStart; // SysTick
+static uint32_t u32I2CTimeout; // SysTick ticks
+static int iI2CSpeed, bI2CNewSpeed;
+static volatile int bI2CRecovering; // I2C1 is being reset by I2CService()
+static I2CSTATS i2cStats;
+
+void I2C1_EV_IRQHandler(void) __attribute__((interrupt));
+void I2C1_ER_IRQHandler(void) __attribute__((interrupt));
+
+//
+// The queue functions may be called from a completion callback, which
+// runs in the I2C interrupt, so they put the interrupt enable back the
+// way they found it instead of always turning it on
+//
+static uint32_t i2cMaskIRQ(void)
+{
+    uint32_t u32Status = __get_MSTATUS();
+
+    __disable_irq();
+    return u32Status;
+} /* i2cMaskIRQ() */
+
+static void i2cRestoreIRQ(uint32_t u32Status)
+{
+    if (u32Status & 0x8) // MIE
+        __enable_irq();
+} /* i2cRestoreIRQ() */
+
+static void i2cSetup(void)
+{
+    I2C_InitTypeDef I2C_InitStructure={0};
+
+    I2C_DeInit(I2C1);
+    I2C_InitStructure.I2C_ClockSpeed = iI2CSpeed;
+    I2C_InitStructure.I2C_Mode = I2C_Mode_I2C;
+    I2C_InitStructure.I2C_DutyCycle = I2C_DutyCycle_16_9;
+    I2C_InitStructure.I2C_OwnAddress1 = 0x02; //address; sender's unimportant address
+    I2C_InitStructure.I2C_Ack = I2C_Ack_Enable;
+    I2C_InitStructure.I2C_AcknowledgedAddress = I2C_AcknowledgedAddress_7bit;
+    I2C_Init( I2C1, &I2C_InitStructure );
+    I2C_Cmd( I2C1, ENABLE );
+    I2C_AcknowledgeConfig( I2C1, ENABLE );
+} /* i2cSetup() */
+
+//
+// Busy wait of half a 100kHz clock period; SysTick isn't reloaded like
+// Delay_Us() would, so a wait being timed elsewhere isn't disturbed
+//
+static void i2cRecoverDelay(void)
+{
+    uint64_t u64Start = SysTick_Read();
+    uint32_t u32Ticks = SysTick_Hz() / 200000;
+
+    while (SysTick_Elapsed(u64Start) <= u32Ticks) {};
+} /* i2cRecoverDelay() */
+
+//
+// A slave which lost a transfer half way through a read can hold SDA
+// low until it has sent the rest of its byte, and the peripheral can't
+// generate START or STOP past it. Clock SCL from the pins (while I2C1
+// is held in reset) until SDA is released, then finish with a STOP
+//
+static void i2cRecoverBus(void)
+{
+    GPIO_InitTypeDef GPIO_InitStructure={0};
+    PINHANDLE hSCL, hSDA;
+    int i;
+
+    pinGetHandle(I2C_SCL_PIN, &hSCL);
+    pinGetHandle(I2C_SDA_PIN, &hSDA);
+    pinSet(&hSCL); // released
+    pinSet(&hSDA);
+    pinMode(I2C_SCL_PIN, OUTPUT_OPEN_DRAIN);
+    pinMode(I2C_SDA_PIN, OUTPUT_OPEN_DRAIN);
+    for (i=0; i<I2C_RECOVER_PULSES && !pinRead(&hSDA); i++) {
+        pinClear(&hSCL);
+        i2cRecoverDelay();
+        pinSet(&hSCL);
+        i2cRecoverDelay();
+    }
+    // STOP: SDA goes high while SCL is high
+    pinClear(&hSCL);
+    i2cRecoverDelay();
+    pinClear(&hSDA);
+    i2cRecoverDelay();
+    pinSet(&hSCL);
+    i2cRecoverDelay();
+    pinSet(&hSDA);
+    i2cRecoverDelay();
+    // give the pins back to the peripheral
+    GPIO_InitStructure.GPIO_Pin = hSCL.u16Mask | hSDA.u16Mask;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_OD;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_Init(hSCL.pPort, &GPIO_InitStructure);
+} /* i2cRecoverBus() */
+
+//
+// Start the next queued transaction (interrupts must be masked or
+// this must be running in the I2C interrupt)
+//
+static void i2cStartNext(void)
+{
+    I2CTRANSACTION *p;
+    int i;
+
+    if (iI2CHead == iI2CTail) { // nothing left to do
+        pI2CActive = NULL;
+        I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR, DISABLE);
+        return;
+    }
+    p = pI2CQueue[iI2CTail];
+    iI2CTail = (iI2CTail + 1) % I2C_QUEUE_SIZE;
+    p->iStatus = I2C_STATUS_BUSY;
+    pI2CActive = p;
+    iI2CPhase = (p->iWriteLen || p->iReadLen == 0) ? I2C_PHASE_WRITE : I2C_PHASE_READ;
+    iI2CIndex = 0;
+    u64I2CStart = SysTick_Read();
+    u32I2CTimeout = (uint32_t)(((uint64_t)((p->u32TimeoutUs) ? p->u32TimeoutUs : I2C_DEFAULT_TIMEOUT_US) * SysTick_Hz()) / 1000000);
+    for (i=0; i<1000 && (I2C1->CTLR1 & I2C_CTLR1_STOP); i++) {}; // the last STOP is still going out
+    if (bI2CNewSpeed) { // I2CSetSpeed() was called during a transfer
+        i2cSetup();
+        bI2CNewSpeed = 0;
+    }
+    I2C1->CTLR1 |= I2C_CTLR1_ACK;
+    I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR, ENABLE);
+    I2C1->CTLR1 |= I2C_CTLR1_START;
+} /* i2cStartNext() */
+
+static void i2cFinish(int iStatus)
+{
+    I2CTRANSACTION *p = pI2CActive;
+
+    pI2CActive = NULL;
+    if (p) {
+        i2cStats.u32Bytes += iI2CIndex + ((iI2CPhase == I2C_PHASE_READ) ? p->iWriteLen : 0);
+        i2cStats.u32Ticks += (uint32_t)SysTick_Elapsed(u64I2CStart);
+        if (iStatus == I2C_STATUS_TIMEOUT)
+            i2cStats.u32Timeouts++;
+        p->iStatus = iStatus;
+        if (p->pfnDone)
+            (*p->pfnDone)(p);
+    }
+    if (pI2CActive == NULL) // the callback's I2CSubmit() may have started one
+        i2cStartNext();
+} /* i2cFinish() */
+
+//
+// The write part is done: repeated START for the read part, or STOP
+//
+static void i2cWriteDone(void)
+{
+    if (pI2CActive->iReadLen) {
+        iI2CPhase = I2C_PHASE_READ;
+        iI2CIndex = 0;
+        I2C_ITConfig(I2C1, I2C_IT_BUF, ENABLE);
+        I2C1->CTLR1 |= I2C_CTLR1_START;
+    } else {
+        I2C1->CTLR1 |= I2C_CTLR1_STOP;
+        i2cFinish(I2C_STATUS_OK);
+    }
+} /* i2cWriteDone() */
+
+void I2C1_EV_IRQHandler(void)
+{
+    I2CTRANSACTION *p = pI2CActive;
+    uint16_t u16Status = I2C1->STAR1;
+
+    if (p == NULL) { // spurious; nothing to do
+        I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF, DISABLE);
+        return;
+    }
+    if (u16Status & I2C_STAR1_SB) { // START sent; the address goes next
+        I2C1->DATAR = (p->u8Addr << 1) | ((iI2CPhase == I2C_PHASE_READ) ? 1 : 0);
+        return;
+    }
+    if (u16Status & I2C_STAR1_ADDR) { // reading STAR2 after STAR1 clears ADDR
+        if (iI2CPhase == I2C_PHASE_READ) {
+            if (p->iReadLen == 1) { // NACK + STOP must be set up before the byte arrives
+                I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
+                (void)I2C1->STAR2;
+                I2C1->CTLR1 |= I2C_CTLR1_STOP;
+            } else {
+                (void)I2C1->STAR2;
+            }
+        } else {
+            (void)I2C1->STAR2;
+            if (p->iWriteLen == 0) // address only (e.g. I2CTest)
+                i2cWriteDone();
+        }
+        return;
+    }
+    if (iI2CPhase == I2C_PHASE_WRITE) {
+        if ((u16Status & I2C_STAR1_TXE) && iI2CIndex < p->iWriteLen) {
+            I2C1->DATAR = p->pWrite[iI2CIndex++];
+            if (iI2CIndex == p->iWriteLen) // wait for BTF instead of TXE
+                I2C_ITConfig(I2C1, I2C_IT_BUF, DISABLE);
+        } else if (u16Status & I2C_STAR1_BTF) {
+            i2cWriteDone();
+        }
+    } else if (u16Status & I2C_STAR1_RXNE) {
+        p->pRead[iI2CIndex++] = (uint8_t)I2C1->DATAR;
+        if (p->iReadLen - iI2CIndex == 1) { // the next byte is the last one
+            I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
+            I2C1->CTLR1 |= I2C_CTLR1_STOP;
+        }
+        if (iI2CIndex == p->iReadLen)
+            i2cFinish(I2C_STATUS_OK);
+    }
+} /* I2C1_EV_IRQHandler() */
+
+void I2C1_ER_IRQHandler(void)
+{
+    uint16_t u16Status = I2C1->STAR1;
+
+    // the error flags are cleared by writing 0 to them
+    I2C1->STAR1 = ~(u16Status & (I2C_STAR1_AF | I2C_STAR1_BERR | I2C_STAR1_ARLO | I2C_STAR1_OVR));
+    if (pI2CActive == NULL) return;
+    I2C1->CTLR1 |= I2C_CTLR1_STOP;
+    if (u16Status & I2C_STAR1_AF) {
+        i2cStats.u32Nacks++;
+        i2cFinish(I2C_STATUS_NACK);
+    } else {
+        i2cStats.u32Errors++;
+        i2cFinish(I2C_STATUS_ERROR);
+    }
+} /* I2C1_ER_IRQHandler() */
+
+//
+// Queue a transaction; the buffers and the structure itself must stay
+// valid until it has finished. Returns 0, or -1 if the queue is full
+//
+int I2CSubmit(I2CTRANSACTION *pTrans)
+{
+    uint32_t u32IRQ;
+    int iNext;
+
+    u32IRQ = i2cMaskIRQ();
+    iNext = (iI2CHead + 1) % I2C_QUEUE_SIZE;
+    if (iNext == iI2CTail) {
+        i2cRestoreIRQ(u32IRQ);
+        return -1;
+    }
+    pTrans->iStatus = I2C_STATUS_QUEUED;
+    pI2CQueue[iI2CHead] = pTrans;
+    iI2CHead = iNext;
+    if (pI2CActive == NULL && !bI2CRecovering)
+        i2cStartNext();
+    i2cRestoreIRQ(u32IRQ);
+    return 0;
+} /* I2CSubmit() */
+
+//
+// Call now and then from the main loop; abandons a transaction which has
+// run past its timeout (e.g. a slave holding the bus), clocks the bus
+// free and resets I2C1. Interrupts are only masked while the transaction
+// is detached and finished; the slow bus recovery runs with them enabled
+// (new submissions wait in the queue until it's done)
+//
+void I2CService(void)
+{
+    I2CTRANSACTION *p;
+    uint32_t u32IRQ;
+
+    u32IRQ = i2cMaskIRQ();
+    p = pI2CActive;
+    if (p == NULL || bI2CRecovering || SysTick_Elapsed(u64I2CStart) <= u32I2CTimeout) {
+        i2cRestoreIRQ(u32IRQ);
+        return;
+    }
+    I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR, DISABLE);
+    pI2CActive = NULL; // a late I2C interrupt leaves it alone
+    bI2CRecovering = 1;
+    bI2CNewSpeed = 0; // i2cSetup() below uses the current speed
+    i2cRestoreIRQ(u32IRQ);
+
+    I2C_SoftwareResetCmd(I2C1, ENABLE);
+    i2cRecoverBus();
+    I2C_SoftwareResetCmd(I2C1, DISABLE);
+    i2cSetup();
+
+    u32IRQ = i2cMaskIRQ();
+    bI2CRecovering = 0;
+    pI2CActive = p;
+    i2cFinish(I2C_STATUS_TIMEOUT); // and start the next one
+    i2cRestoreIRQ(u32IRQ);
+} /* I2CService() */
+
+//
+// Wait for a submitted transaction to finish; returns its status
+//
+int I2CWaitTransaction(I2CTRANSACTION *pTrans)
+{
+    while (pTrans->iStatus == I2C_STATUS_QUEUED || pTrans->iStatus == I2C_STATUS_BUSY)
+        I2CService();
+    return pTrans->iStatus;
+} /* I2CWaitTransaction() */
+
+static int i2cTransfer(uint8_t u8Addr, uint8_t *pWrite, int iWriteLen, uint8_t *pRead, int iReadLen)
+{
+    I2CTRANSACTION t = {0};
+
+    t.u8Addr = u8Addr;
+    t.pWrite = pWrite;
+    t.iWriteLen = iWriteLen;
+    t.pRead = pRead;
+    t.iReadLen = iReadLen;
+    while (I2CSubmit(&t) != 0) // wait for room in the queue
+        I2CService();
+    return I2CWaitTransaction(&t);
+} /* i2cTransfer() */
+
+//
+// Change the bus clock; if a transaction is running (or I2CService() is
+// recovering the bus), the peripheral is set up again before the next one
+// starts instead. Interrupts are masked so an I2CSubmit() from an ISR
+// can't start one while I2C1 is reset
+//
+void I2CSetSpeed(int iSpeed)
+{
+    uint32_t u32IRQ;
+
+    u32IRQ = i2cMaskIRQ();
+    iI2CSpeed = iSpeed;
+    i2cStats.u32Speed = (uint32_t)iSpeed;
+    if (pI2CActive == NULL && !bI2CRecovering) {
+        i2cSetup();
+        bI2CNewSpeed = 0;
+    } else {
+        bI2CNewSpeed = 1;
+    }
+    i2cRestoreIRQ(u32IRQ);
+} /* I2CSetSpeed() */
+
+void I2CGetStats(I2CSTATS *pStats)
+{
+    *pStats = i2cStats;
+    pStats->u32BytesPerSec = 0;
+    if (i2cStats.u32Ticks)
+        pStats->u32BytesPerSec = (uint32_t)(((uint64_t)i2cStats.u32Bytes * SysTick_Hz()) / i2cStats.u32Ticks);
+} /* I2CGetStats() */
+
+void I2CResetStats(void)
+{
+    uint32_t u32Speed = i2cStats.u32Speed;
+
+    memset(&i2cStats, 0, sizeof(i2cStats));
+    i2cStats.u32Speed = u32Speed;
+} /* I2CResetStats() */
 
 void I2CInit(uint8_t a, uint8_t b, int iSpeed)
 {
 	(void)a;
 	(void)b;
     GPIO_InitTypeDef GPIO_InitStructure={0};
-    I2C_InitTypeDef I2C_InitStructure={0};
+    NVIC_InitTypeDef NVIC_InitStructure={0};
     //I2C_DeInit(I2C1);
 
 #ifdef __CH32V20x_H
@@ -376,98 +1167,56 @@ void I2CInit(uint8_t a, uint8_t b, int iSpeed)
     GPIO_Init( GPIOC, &GPIO_InitStructure );
 #endif
 
-    I2C_DeInit(I2C1);
- //   I2C_StructInit(&I2C_InitStructure);
-    I2C_InitStructure.I2C_ClockSpeed = iSpeed;
-    I2C_InitStructure.I2C_Mode = I2C_Mode_I2C;
-    I2C_InitStructure.I2C_DutyCycle = I2C_DutyCycle_16_9;
-    I2C_InitStructure.I2C_OwnAddress1 = 0x02; //address; sender's unimportant address
-    I2C_InitStructure.I2C_Ack = I2C_Ack_Enable;
-    I2C_InitStructure.I2C_AcknowledgedAddress = I2C_AcknowledgedAddress_7bit;
-    I2C_Init( I2C1, &I2C_InitStructure );
-
-    I2C_Cmd( I2C1, ENABLE );
-
-    I2C_AcknowledgeConfig( I2C1, ENABLE );
-//    while( I2C_GetFlagStatus( I2C1, I2C_FLAG_BUSY ) != RESET );
+    iI2CHead = iI2CTail = 0;
+    pI2CActive = NULL;
+    bI2CRecovering = 0;
+    iI2CSpeed = iSpeed;
+    i2cSetup();
+    I2CResetStats();
+    i2cStats.u32Speed = (uint32_t)iSpeed;
+
+    NVIC_InitStructure.NVIC_IRQChannel = I2C1_EV_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    NVIC_InitStructure.NVIC_IRQChannel = I2C1_ER_IRQn;
+    NVIC_Init(&NVIC_InitStructure);
 } /* I2CInit() */
 
 void I2CRead(uint8_t u8Addr, uint8_t *pData, int iLen)
 {
-    I2C_GenerateSTART( I2C1, ENABLE );
-    while( !I2C_CheckEvent( I2C1, I2C_EVENT_MASTER_MODE_SELECT ) );
-
-    I2C_Send7bitAddress( I2C1, u8Addr<<1, I2C_Direction_Receiver );
-
-    while( !I2C_CheckEvent( I2C1, I2C_EVENT_MASTER_RECEIVER_MODE_SELECTED ) );
-
-    while(iLen)
-    {
-        if( I2C_GetFlagStatus( I2C1, I2C_FLAG_RXNE ) !=  RESET )
-        {
-            pData[0] = I2C_ReceiveData( I2C1 );
-            pData++;
-            iLen--;
-        }
-    }
-
-    I2C_GenerateSTOP( I2C1, ENABLE );
-
-
+    i2cTransfer(u8Addr, NULL, 0, pData, iLen);
 } /* I2CRead() */
 
 void I2CWrite(uint8_t u8Addr, uint8_t *pData, int iLen)
 {
-    while( I2C_GetFlagStatus( I2C1, I2C_FLAG_BUSY ) != RESET );
-    I2C_GenerateSTART( I2C1, ENABLE );
-    while( !I2C_CheckEvent( I2C1, I2C_EVENT_MASTER_MODE_SELECT ) );
-
-    I2C_Send7bitAddress( I2C1, u8Addr<<1, I2C_Direction_Transmitter );
-
-    while( !I2C_CheckEvent( I2C1, I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED ) );
-
-    while(iLen)
-    {
-        if( I2C_GetFlagStatus( I2C1, I2C_FLAG_TXE ) !=  RESET )
-        {
-            I2C_SendData( I2C1, pData[0] );
-            pData++;
-            iLen--;
-        }
-    }
-
-    while( !I2C_CheckEvent( I2C1, I2C_EVENT_MASTER_BYTE_TRANSMITTED ) );
-    I2C_GenerateSTOP( I2C1, ENABLE );
-
+    i2cTransfer(u8Addr, pData, iLen, NULL, 0);
 } /* I2CWrite() */
 
 int I2CTest(uint8_t u8Addr)
 {
-    I2C_GenerateSTART( I2C1, ENABLE );
-    while( !I2C_CheckEvent( I2C1, I2C_EVENT_MASTER_MODE_SELECT ) );
-
-    I2C_Send7bitAddress( I2C1, u8Addr<<1, I2C_Direction_Transmitter );
-
-    while( !I2C_CheckEvent( I2C1, I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED ) );
-    I2C_GenerateSTOP( I2C1, ENABLE );
-    return (I2C_GetFlagStatus(I2C1, I2C_FLAG_TXE) != RESET); // 0 = fail, 1 = succeed
-
+    return (i2cTransfer(u8Addr, NULL, 0, NULL, 0) == I2C_STATUS_OK); // 0 = fail, 1 = succeed
 } /* I2CTest() */
 #endif // BITBANG
 
 //
 // Read N bytes starting at a specific I2C internal register
+// (register number write, repeated START, read)
 // returns 1 for success, 0 for error
 //
 int I2CReadRegister(uint8_t iAddr, uint8_t u8Register, uint8_t *pData, int iLen)
 {
-//  int rc;
-
-  I2CWrite(iAddr, &u8Register, 1);
-  Delay_Ms(5);
-  I2CRead(iAddr, pData, iLen);
-
-return 1; // returns 1 for success, 0 for error
+I2CTRANSACTION t = {0};
+
+  t.u8Addr = iAddr;
+  t.pWrite = &u8Register;
+  t.iWriteLen = 1;
+  t.pRead = pData;
+  t.iReadLen = iLen;
+  while (I2CSubmit(&t) != 0) // the queue is full
+     I2CService();
+  return (I2CWaitTransaction(&t) == I2C_STATUS_OK);
 } /* I2CReadRegister() */
 
 // Put CPU into standby mode for a multiple of 82ms tick increments
@@ -612,3 +1361,21 @@ void SPI_write(uint8_t *pData, int iLen)
     {}; // wait until it's not busy
 
 } /* SPI_write() */
+
+// polling write of 16-bit frames (SPI1 must be in 16-bit mode)
+void SPI_write16(uint16_t *pData, int iLen)
+{
+	int i = 0;
+
+    while (i < iLen)
+    {
+    	if ( SPI_I2S_GetFlagStatus( SPI1, SPI_I2S_FLAG_TXE ) != RESET )
+          SPI_I2S_SendData( SPI1, pData[i++] );
+    }
+    // wait until transmit empty flag is true
+    while (SPI_I2S_GetFlagStatus( SPI1, SPI_I2S_FLAG_TXE ) == RESET)
+    {};
+    while (SPI_I2S_GetFlagStatus( SPI1, SPI_I2S_FLAG_BSY ) == SET)
+    {}; // wait until it's not busy
+
+} /* SPI_write16() */
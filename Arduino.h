@@ -15,14 +15,19 @@
 #ifndef USER_ARDUINO_H_
 #define USER_ARDUINO_H_
 
-#define BITBANG
+// The bit-banged I2C master is the default; build with -DBITBANG=0 for the
+// interrupt driven I2C1 peripheral
+#ifndef BITBANG
+#define BITBANG 1
+#endif
 
 // GPIO pin states
 enum {
 	OUTPUT = 0,
 	INPUT,
 	INPUT_PULLUP,
-	INPUT_PULLDOWN
+	INPUT_PULLDOWN,
+	OUTPUT_OPEN_DRAIN
 };
 
 #define PROGMEM
@@ -32,6 +37,11 @@ enum {
 
 // Wrapper methods
 void delay(int i);
+// Core timer (SysTick) shared with Delay_Us()/Delay_Ms(); it's started
+// if it's stopped but its clock and direction are left alone
+uint64_t SysTick_Read(void);
+uint64_t SysTick_Elapsed(uint64_t u64Start);
+uint32_t SysTick_Hz(void);
 //
 // Digital pin functions use a numbering scheme to make it easier to map the
 // pin number to a port name and number
@@ -42,6 +52,53 @@ void pinMode(uint8_t u8Pin, int iMode);
 uint8_t digitalRead(uint8_t u8Pin);
 void digitalWrite(uint8_t u8Pin, uint8_t u8Value);
 
+//
+// Pin handles for the hot paths
+// The port and bit mask of a pin are looked up once; after that, setting
+// or clearing the pin is a single store to the port's BSHR or BCR
+// register (atomic, no read-modify-write). Invalid pins get a handle to
+// a dummy port, so writes to them are harmless.
+// GPIO_WRITTEN() lets a host build notice the register writes.
+//
+#ifndef GPIO_WRITTEN
+#define GPIO_WRITTEN(pPort)
+#endif
+typedef struct pin_handle_tag {
+	GPIO_TypeDef *pPort;
+	uint16_t u16Mask;
+} PINHANDLE;
+
+int pinGetHandle(uint8_t u8Pin, PINHANDLE *pHandle);
+
+static inline void pinSet(const PINHANDLE *pHandle)
+{
+	pHandle->pPort->BSHR = pHandle->u16Mask;
+	GPIO_WRITTEN(pHandle->pPort);
+}
+static inline void pinClear(const PINHANDLE *pHandle)
+{
+	pHandle->pPort->BCR = pHandle->u16Mask;
+	GPIO_WRITTEN(pHandle->pPort);
+}
+static inline void pinWrite(const PINHANDLE *pHandle, uint8_t u8Value)
+{
+	// the upper half of BSHR resets the pin, the lower half sets it
+	pHandle->pPort->BSHR = (u8Value) ? pHandle->u16Mask : ((uint32_t)pHandle->u16Mask << 16);
+	GPIO_WRITTEN(pHandle->pPort);
+}
+static inline void pinToggle(const PINHANDLE *pHandle)
+{
+	uint32_t u32Set = pHandle->pPort->OUTDR & pHandle->u16Mask;
+
+	pHandle->pPort->BSHR = (u32Set << 16) | (pHandle->u16Mask & ~u32Set);
+	GPIO_WRITTEN(pHandle->pPort);
+}
+// Reads the pin itself; for an open-drain output this is the line level
+static inline uint8_t pinRead(const PINHANDLE *pHandle)
+{
+	return (pHandle->pPort->INDR & pHandle->u16Mask) != 0;
+}
+
 // The Wire library is a C++ class; I've created a work-alike to my
 // BitBang_I2C API which is a set of C functions to simplify I2C
 void I2CSetSpeed(int iSpeed);
@@ -52,15 +109,74 @@ void I2CWrite(uint8_t u8Addr, uint8_t *pData, int iLen);
 void I2CRead(uint8_t u8Addr, uint8_t *pData, int iLen);
 int I2CTest(uint8_t u8Addr);
 
+// Bus statistics since I2CResetStats()
+typedef struct i2c_stats_tag {
+	uint32_t u32Speed;       // requested clock (Hz)
+	uint32_t u32Bytes;       // bytes sent or received
+	uint32_t u32Ticks;       // SysTick ticks from START to STOP
+	uint32_t u32BytesPerSec; // filled in by I2CGetStats()
+	uint32_t u32Stretches;   // times a slave held SCL low (bit-banged only)
+	uint32_t u32Timeouts;    // stretches or transactions which never ended
+	uint32_t u32Nacks;       // transactions refused by the slave (hardware only)
+	uint32_t u32Errors;      // bus errors / lost arbitration (hardware only)
+} I2CSTATS;
+void I2CGetStats(I2CSTATS *pStats);
+void I2CResetStats(void);
+
+// Non-blocking transactions: an optional write followed by an optional
+// read (with a repeated START in between). With the hardware I2C they
+// are queued and run from its interrupts; the bit-banged version
+// carries them out inside I2CSubmit()
+enum {
+	I2C_STATUS_IDLE = 0,
+	I2C_STATUS_QUEUED,
+	I2C_STATUS_BUSY,
+	I2C_STATUS_OK,
+	I2C_STATUS_NACK,    // the slave didn't acknowledge
+	I2C_STATUS_TIMEOUT,
+	I2C_STATUS_ERROR    // bus error or lost arbitration
+};
+struct i2c_transaction_tag;
+typedef void (*I2C_CALLBACK)(struct i2c_transaction_tag *pTrans);
+typedef struct i2c_transaction_tag {
+	uint8_t u8Addr;          // 7-bit slave address
+	uint8_t *pWrite;
+	int iWriteLen;
+	uint8_t *pRead;
+	int iReadLen;
+	uint32_t u32TimeoutUs;   // 0 = default
+	I2C_CALLBACK pfnDone;    // optional; called from interrupt context
+	void *pUser;
+	volatile int iStatus;    // I2C_STATUS_xxx
+} I2CTRANSACTION;
+int I2CSubmit(I2CTRANSACTION *pTrans);
+void I2CService(void);
+int I2CWaitTransaction(I2CTRANSACTION *pTrans);
+
 // SPI1 (polling mode)
 void SPI_write(uint8_t *pData, int iLen);
+void SPI_write16(uint16_t *pData, int iLen); // SPI must be set to 16-bit frames
 void SPI_begin(int iSpeed, int iMode);
 
-// USART1 (receive only)
+// USART1 (receive only; polled, or into a ring buffer by DMA)
 void UART_Init(int iBaud);
 void UART_DeInit(void);
 int UART_Read(void);
 #define UART_TIMEOUT 10000
+// Interrupt/DMA driven receive into a ring buffer (call after UART_Init)
+typedef struct uart_stats_tag {
+	uint32_t u32BytesReceived; // total written into the ring buffer
+	uint32_t u32BytesRead;
+	uint32_t u32Overruns;      // times the reader fell a whole buffer behind
+	uint32_t u32BytesLost;     // bytes overwritten before they were read
+} UARTSTATS;
+int UART_BeginRx(uint8_t *pBuffer, int iSize);
+int UART_Available(void);
+int UART_ReadByte(void);
+int UART_Peek(void);
+int UART_ReadBytes(uint8_t *pDest, int iLen);
+int UART_ReadLine(char *szLine, int iMax);
+void UART_GetStats(UARTSTATS *pStats);
 
 // Random stuff
 void Standby82ms(uint8_t iTicks);
@@ -0,0 +1,144 @@
+//
+// bench_expand.c
+// Microbenchmark of the 1-bpp to RGB565 expansion used by the text and
+// pattern drawing functions. The table-driven lcdExpand1bpp() is timed
+// against a plain test-one-bit-per-pixel loop for the common row shapes.
+//
+// Host build:
+//   gcc -O2 -Wall -Ihost -I. Arduino.c spi_lcd.c host/lcd_sim.c host/bench_expand.c -o bench_expand
+// Target: add this file to the firmware project (without main) and call
+// benchExpand() once printf() has been routed to the debug UART. The
+// SysTick counter is run at HCLK, so the results are in CPU cycles; its
+// HCLK/8 setup is put back afterwards for Delay_Us()/Delay_Ms().
+//
+// Copyright 2023 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#include "Arduino.h"
+#include "spi_lcd.h"
+
+#if defined(__riscv)
+#define BENCH_UNIT "cycles"
+static uint32_t u32SavedCTLR;
+static void benchTimerInit(void)
+{
+    u32SavedCTLR = SysTick->CTLR;
+    SysTick->CTLR = 0;
+    SysTick->CNT = 0;
+    SysTick->CTLR = 5; // count up from HCLK
+} /* benchTimerInit() */
+static void benchTimerDone(void)
+{
+    SysTick->CTLR = u32SavedCTLR & ~1; // stopped, as Delay_Us() leaves it
+} /* benchTimerDone() */
+static uint64_t benchTicks(void)
+{
+    return SysTick->CNT;
+} /* benchTicks() */
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "TSC ticks"
+static void benchTimerInit(void) {}
+static void benchTimerDone(void) {}
+static uint64_t benchTicks(void)
+{
+    return __rdtsc();
+} /* benchTicks() */
+#else
+#include <time.h>
+#define BENCH_UNIT "ns"
+static void benchTimerInit(void) {}
+static void benchTimerDone(void) {}
+static uint64_t benchTicks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+} /* benchTicks() */
+#endif
+
+#define BENCH_PIXELS 320
+static uint8_t u8Bits[BENCH_PIXELS/8 + 1];
+static uint16_t u16Out[BENCH_PIXELS + 2], u16Ref[BENCH_PIXELS + 2];
+
+//
+// The way each drawing function used to expand its bits
+//
+static void benchExpandNaive(const uint8_t *pSrc, int iBitOff, int iCount, uint16_t *pDest, uint16_t u16FG, uint16_t u16BG)
+{
+    int i;
+
+    for (i=0; i<iCount; i++, iBitOff++)
+        pDest[i] = (pSrc[iBitOff >> 3] & (0x80 >> (iBitOff & 7))) ? u16FG : u16BG;
+} /* benchExpandNaive() */
+
+//
+// Time iLoops expansions of iCount pixels and print the cost per pixel
+// Returns 0 if both methods produce the same pixels
+//
+static int benchCase(const char *szName, int iBitOff, int iDestOff, int iCount, int iLoops, int bNewColors)
+{
+    int i;
+    uint64_t u64Start, u64Naive, u64LUT;
+    uint16_t u16FG = 0xffff, u16BG;
+
+    u64Start = benchTicks();
+    for (i=0; i<iLoops; i++) {
+        u16BG = (bNewColors) ? (uint16_t)i : 0x001f;
+        benchExpandNaive(u8Bits, iBitOff, iCount, &u16Ref[iDestOff], u16FG, u16BG);
+    }
+    u64Naive = benchTicks() - u64Start;
+    u64Start = benchTicks();
+    for (i=0; i<iLoops; i++) {
+        u16BG = (bNewColors) ? (uint16_t)i : 0x001f; // new colors rebuild the table
+        lcdExpand1bpp(u8Bits, iBitOff, iCount, &u16Out[iDestOff], u16FG, u16BG);
+    }
+    u64LUT = benchTicks() - u64Start;
+    printf("%-28s naive %6.2f  table %6.2f %s/pixel\n", szName,
+           (double)u64Naive / ((double)iLoops * iCount),
+           (double)u64LUT / ((double)iLoops * iCount), BENCH_UNIT);
+    return memcmp(&u16Out[iDestOff], &u16Ref[iDestOff], iCount * sizeof(uint16_t)) != 0;
+} /* benchCase() */
+
+//
+// Runs a fixed set of cases; returns the number of mismatches
+//
+int benchExpand(void)
+{
+    int i, iErrors = 0;
+    uint32_t u32Seed = 0x1234567;
+
+    for (i=0; i<(int)sizeof(u8Bits); i++) {
+        u32Seed = u32Seed * 1103515245 + 12345;
+        u8Bits[i] = (uint8_t)(u32Seed >> 16);
+    }
+    benchTimerInit();
+    printf("1-bpp to RGB565 expansion\n");
+    iErrors += benchCase("6x8 glyph row (6 px)", 0, 0, 6, 20000, 0);
+    iErrors += benchCase("8x8 glyph row (8 px)", 0, 0, 8, 20000, 0);
+    iErrors += benchCase("12x16 glyph row (12 px)", 0, 0, 12, 20000, 0);
+    iErrors += benchCase("pattern row (320 px)", 0, 0, BENCH_PIXELS, 2000, 0);
+    iErrors += benchCase("clipped row (317 px, +3 bit)", 3, 1, BENCH_PIXELS-3, 2000, 0);
+    iErrors += benchCase("8 px, new colors each call", 0, 0, 8, 20000, 1);
+    benchTimerDone();
+    if (iErrors)
+        printf("%d case(s) produced different pixels!\n", iErrors);
+    return iErrors;
+} /* benchExpand() */
+
+#if !defined(__riscv)
+int main(int argc, char *argv[])
+{
+    (void)argc; (void)argv;
+    return benchExpand();
+} /* main() */
+#endif
@@ -0,0 +1,458 @@
+//
+// debug.h (host)
+// Stand-in for the WCH debug.h/ch32v20x.h headers so that Arduino.c and
+// spi_lcd.c can be compiled and run unchanged on a Linux PC.
+// Only the subset of the standard peripheral library used by this project
+// is provided. The peripherals are plain structs in RAM; the functions in
+// lcd_sim.c give them enough behavior to drive a virtual LCD panel.
+//
+// Copyright 2023 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#ifndef HOST_DEBUG_H_
+#define HOST_DEBUG_H_
+
+#include <stdint.h>
+
+// The simulated part is a CH32V203
+#define __CH32V20x_H
+
+// The RISC-V toolchain marks ISRs with __attribute__((interrupt)); on x86
+// that attribute means something else, so turn it into a harmless one
+#define interrupt used
+
+#define __IO volatile
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t u8;
+
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+typedef enum {Bit_RESET = 0, Bit_SET} BitAction;
+
+extern uint32_t SystemCoreClock;
+
+void Delay_Us(uint32_t n);
+void Delay_Ms(uint32_t n);
+
+//
+// Peripheral register blocks (same names and order as ch32v20x.h)
+// Register fields which hold bus addresses are pointer sized so that
+// DMA memory addresses survive on a 64-bit host
+//
+typedef struct {
+    __IO uint32_t CFGLR;
+    __IO uint32_t CFGHR;
+    __IO uint32_t INDR;
+    __IO uint32_t OUTDR;
+    __IO uint32_t BSHR;
+    __IO uint32_t BCR;
+    __IO uint32_t LCKR;
+} GPIO_TypeDef;
+
+typedef struct {
+    __IO uint16_t CTLR1;
+    __IO uint16_t CTLR2;
+    __IO uint16_t STATR;
+    __IO uint16_t DATAR;
+    __IO uint16_t CRCR;
+    __IO uint16_t RCRCR;
+    __IO uint16_t TCRCR;
+    __IO uint16_t I2SCFGR;
+    __IO uint16_t I2SPR;
+    __IO uint16_t HSCR;
+} SPI_TypeDef;
+
+typedef struct {
+    __IO uint32_t CFGR;
+    __IO uint32_t CNTR;
+    __IO uintptr_t PADDR;
+    __IO uintptr_t MADDR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+    __IO uint32_t INTFR;
+    __IO uint32_t INTFCR;
+} DMA_TypeDef;
+
+typedef struct {
+    __IO uint16_t STATR;
+    __IO uint16_t DATAR;
+    __IO uint16_t BRR;
+    __IO uint16_t CTLR1;
+    __IO uint16_t CTLR2;
+    __IO uint16_t CTLR3;
+    __IO uint16_t GPR;
+} USART_TypeDef;
+
+typedef struct {
+    __IO uint16_t CTLR1;
+    __IO uint16_t CTLR2;
+    __IO uint16_t OADDR1;
+    __IO uint16_t OADDR2;
+    __IO uint16_t DATAR;
+    __IO uint16_t STAR1;
+    __IO uint16_t STAR2;
+    __IO uint16_t CKCFGR;
+    __IO uint16_t RTR;
+} I2C_TypeDef;
+
+typedef struct {
+    __IO uint32_t ECR;
+    __IO uint32_t PCFR1;
+} AFIO_TypeDef;
+
+// Core timer; CNT follows the simulated time while enabled, at HCLK with
+// STCLK (bit 2) set and HCLK/8 otherwise
+typedef struct {
+    __IO uint32_t CTLR;
+    __IO uint32_t SR;
+    __IO uint64_t CNT;
+    __IO uint64_t CMP;
+} SysTick_Type;
+
+extern GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC, sim_GPIOD;
+extern SPI_TypeDef sim_SPI1;
+extern DMA_TypeDef sim_DMA1;
+extern DMA_Channel_TypeDef sim_DMA1_Channel3, sim_DMA1_Channel5;
+extern USART_TypeDef sim_USART1;
+extern I2C_TypeDef sim_I2C1;
+extern AFIO_TypeDef sim_AFIO;
+extern SysTick_Type sim_SysTick;
+
+#define GPIOA (&sim_GPIOA)
+#define GPIOB (&sim_GPIOB)
+#define GPIOC (&sim_GPIOC)
+#define GPIOD (&sim_GPIOD)
+#define SPI1 (&sim_SPI1)
+#define DMA1 (&sim_DMA1)
+#define DMA1_Channel3 (&sim_DMA1_Channel3)
+#define DMA1_Channel5 (&sim_DMA1_Channel5)
+#define USART1 (&sim_USART1)
+#define I2C1 (&sim_I2C1)
+#define AFIO (&sim_AFIO)
+// Every access to the core timer costs the CPU a few cycles; the simulator
+// charges them so that code polling SysTick sees the time pass
+SysTick_Type *simSysTick(void);
+#define SysTick (simSysTick())
+
+// Stores to BSHR/BCR are plain RAM writes here; the pin handle functions
+// in Arduino.h call this so the simulator can apply them to OUTDR
+void simGPIOWritten(GPIO_TypeDef *GPIOx);
+#define GPIO_WRITTEN(pPort) simGPIOWritten(pPort)
+
+// Core intrinsics; the simulated DMA finishes synchronously, so there is
+// never anything to sleep through. Only the MIE bit (3) of mstatus is
+// modeled, so code can be checked for leaving interrupts as it found them
+extern uint32_t sim_MSTATUS;
+static inline void __WFI(void) {}
+static inline void __disable_irq(void) { sim_MSTATUS &= ~0x88; }
+static inline void __enable_irq(void) { sim_MSTATUS |= 0x88; }
+static inline uint32_t __get_MSTATUS(void) { return sim_MSTATUS; }
+static inline void __set_MSTATUS(uint32_t u32Value) { sim_MSTATUS = u32Value; }
+
+#define AFIO_PCFR1_SWJ_CFG_DISABLE 0x04000000
+
+//
+// RCC
+//
+#define RCC_AHBPeriph_DMA1 0x00000001
+#define RCC_APB2Periph_AFIO 0x00000001
+#define RCC_APB2Periph_GPIOA 0x00000004
+#define RCC_APB2Periph_GPIOB 0x00000008
+#define RCC_APB2Periph_GPIOC 0x00000010
+#define RCC_APB2Periph_GPIOD 0x00000020
+#define RCC_APB2Periph_SPI1 0x00001000
+#define RCC_APB2Periph_USART1 0x00004000
+#define RCC_APB1Periph_I2C1 0x00200000
+#define RCC_APB1Periph_PWR 0x10000000
+#define RCC_FLAG_LSIRDY ((uint8_t)0x61)
+
+void RCC_AHBPeriphClockCmd(uint32_t u32Periph, FunctionalState NewState);
+void RCC_APB2PeriphClockCmd(uint32_t u32Periph, FunctionalState NewState);
+void RCC_APB1PeriphClockCmd(uint32_t u32Periph, FunctionalState NewState);
+void RCC_APB1PeriphResetCmd(uint32_t u32Periph, FunctionalState NewState);
+void RCC_LSICmd(FunctionalState NewState);
+FlagStatus RCC_GetFlagStatus(uint8_t u8Flag);
+
+//
+// GPIO
+//
+#define GPIO_Pin_0 ((uint16_t)0x0001)
+#define GPIO_Pin_1 ((uint16_t)0x0002)
+#define GPIO_Pin_2 ((uint16_t)0x0004)
+#define GPIO_Pin_3 ((uint16_t)0x0008)
+#define GPIO_Pin_4 ((uint16_t)0x0010)
+#define GPIO_Pin_5 ((uint16_t)0x0020)
+#define GPIO_Pin_6 ((uint16_t)0x0040)
+#define GPIO_Pin_7 ((uint16_t)0x0080)
+#define GPIO_Pin_8 ((uint16_t)0x0100)
+#define GPIO_Pin_9 ((uint16_t)0x0200)
+#define GPIO_Pin_10 ((uint16_t)0x0400)
+#define GPIO_Pin_11 ((uint16_t)0x0800)
+#define GPIO_Pin_12 ((uint16_t)0x1000)
+#define GPIO_Pin_13 ((uint16_t)0x2000)
+#define GPIO_Pin_14 ((uint16_t)0x4000)
+#define GPIO_Pin_15 ((uint16_t)0x8000)
+#define GPIO_Pin_All ((uint16_t)0xFFFF)
+
+typedef enum {
+    GPIO_Speed_10MHz = 1,
+    GPIO_Speed_2MHz,
+    GPIO_Speed_50MHz
+} GPIOSpeed_TypeDef;
+
+typedef enum {
+    GPIO_Mode_AIN = 0x0,
+    GPIO_Mode_IN_FLOATING = 0x04,
+    GPIO_Mode_IPD = 0x28,
+    GPIO_Mode_IPU = 0x48,
+    GPIO_Mode_Out_OD = 0x14,
+    GPIO_Mode_Out_PP = 0x10,
+    GPIO_Mode_AF_OD = 0x1C,
+    GPIO_Mode_AF_PP = 0x18
+} GPIOMode_TypeDef;
+
+typedef struct {
+    uint16_t GPIO_Pin;
+    GPIOSpeed_TypeDef GPIO_Speed;
+    GPIOMode_TypeDef GPIO_Mode;
+} GPIO_InitTypeDef;
+
+#define GPIO_Remap_I2C1 0x00000002
+
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct);
+void GPIO_DeInit(GPIO_TypeDef *GPIOx);
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_WriteBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, BitAction BitVal);
+void GPIO_PinRemapConfig(uint32_t GPIO_Remap, FunctionalState NewState);
+
+//
+// SPI
+//
+typedef struct {
+    uint16_t SPI_Direction;
+    uint16_t SPI_Mode;
+    uint16_t SPI_DataSize;
+    uint16_t SPI_CPOL;
+    uint16_t SPI_CPHA;
+    uint16_t SPI_NSS;
+    uint16_t SPI_BaudRatePrescaler;
+    uint16_t SPI_FirstBit;
+    uint16_t SPI_CRCPolynomial;
+} SPI_InitTypeDef;
+
+#define SPI_Direction_2Lines_FullDuplex ((uint16_t)0x0000)
+#define SPI_Direction_1Line_Tx ((uint16_t)0xC000)
+#define SPI_Mode_Master ((uint16_t)0x0104)
+#define SPI_DataSize_16b ((uint16_t)0x0800)
+#define SPI_DataSize_8b ((uint16_t)0x0000)
+#define SPI_CPOL_Low ((uint16_t)0x0000)
+#define SPI_CPOL_High ((uint16_t)0x0002)
+#define SPI_CPHA_1Edge ((uint16_t)0x0000)
+#define SPI_CPHA_2Edge ((uint16_t)0x0001)
+#define SPI_NSS_Soft ((uint16_t)0x0200)
+#define SPI_BaudRatePrescaler_2 ((uint16_t)0x0000)
+#define SPI_BaudRatePrescaler_4 ((uint16_t)0x0008)
+#define SPI_BaudRatePrescaler_8 ((uint16_t)0x0010)
+#define SPI_BaudRatePrescaler_16 ((uint16_t)0x0018)
+#define SPI_BaudRatePrescaler_32 ((uint16_t)0x0020)
+#define SPI_BaudRatePrescaler_64 ((uint16_t)0x0028)
+#define SPI_BaudRatePrescaler_128 ((uint16_t)0x0030)
+#define SPI_BaudRatePrescaler_256 ((uint16_t)0x0038)
+#define SPI_FirstBit_MSB ((uint16_t)0x0000)
+#define SPI_I2S_DMAReq_Tx ((uint16_t)0x0002)
+#define SPI_I2S_FLAG_RXNE ((uint16_t)0x0001)
+#define SPI_I2S_FLAG_TXE ((uint16_t)0x0002)
+#define SPI_I2S_FLAG_BSY ((uint16_t)0x0080)
+#define CTLR1_SPE_Set ((uint16_t)0x0040)
+
+void SPI_Init(SPI_TypeDef *SPIx, SPI_InitTypeDef *SPI_InitStruct);
+void SPI_Cmd(SPI_TypeDef *SPIx, FunctionalState NewState);
+void SPI_I2S_DMACmd(SPI_TypeDef *SPIx, uint16_t SPI_I2S_DMAReq, FunctionalState NewState);
+FlagStatus SPI_I2S_GetFlagStatus(SPI_TypeDef *SPIx, uint16_t SPI_I2S_FLAG);
+void SPI_I2S_SendData(SPI_TypeDef *SPIx, uint16_t Data);
+void SPI_DataSizeConfig(SPI_TypeDef *SPIx, uint16_t SPI_DataSize);
+
+//
+// DMA
+//
+typedef struct {
+    uintptr_t DMA_PeripheralBaseAddr; // pointer sized, like the channel registers
+    uintptr_t DMA_MemoryBaseAddr;
+    uint32_t DMA_DIR;
+    uint32_t DMA_BufferSize;
+    uint32_t DMA_PeripheralInc;
+    uint32_t DMA_MemoryInc;
+    uint32_t DMA_PeripheralDataSize;
+    uint32_t DMA_MemoryDataSize;
+    uint32_t DMA_Mode;
+    uint32_t DMA_Priority;
+    uint32_t DMA_M2M;
+} DMA_InitTypeDef;
+
+#define DMA_DIR_PeripheralDST ((uint32_t)0x00000010)
+#define DMA_DIR_PeripheralSRC ((uint32_t)0x00000000)
+#define DMA_PeripheralInc_Enable ((uint32_t)0x00000040)
+#define DMA_PeripheralInc_Disable ((uint32_t)0x00000000)
+#define DMA_MemoryInc_Enable ((uint32_t)0x00000080)
+#define DMA_MemoryInc_Disable ((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_Byte ((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_HalfWord ((uint32_t)0x00000100)
+#define DMA_MemoryDataSize_Byte ((uint32_t)0x00000000)
+#define DMA_MemoryDataSize_HalfWord ((uint32_t)0x00000400)
+#define DMA_Mode_Circular ((uint32_t)0x00000020)
+#define DMA_Mode_Normal ((uint32_t)0x00000000)
+#define DMA_Priority_VeryHigh ((uint32_t)0x00003000)
+#define DMA_M2M_Disable ((uint32_t)0x00000000)
+#define DMA_IT_TC ((uint32_t)0x00000002)
+#define DMA_CFGR1_EN ((uint32_t)0x00000001)
+#define DMA1_IT_GL3 ((uint32_t)0x00000100)
+#define DMA1_IT_TC3 ((uint32_t)0x00000200)
+#define DMA1_IT_GL5 ((uint32_t)0x00010000)
+#define DMA1_IT_TC5 ((uint32_t)0x00020000)
+
+void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx);
+void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct);
+void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState);
+void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState);
+ITStatus DMA_GetITStatus(uint32_t DMAy_IT);
+void DMA_ClearITPendingBit(uint32_t DMAy_IT);
+
+//
+// NVIC
+//
+typedef enum {
+    DMA1_Channel3_IRQn = 29,
+    DMA1_Channel5_IRQn = 31,
+    I2C1_EV_IRQn = 47,
+    I2C1_ER_IRQn = 48,
+    USART1_IRQn = 53
+} IRQn_Type;
+
+typedef struct {
+    uint8_t NVIC_IRQChannel;
+    uint8_t NVIC_IRQChannelPreemptionPriority;
+    uint8_t NVIC_IRQChannelSubPriority;
+    FunctionalState NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct);
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+
+//
+// USART
+//
+typedef struct {
+    uint32_t USART_BaudRate;
+    uint16_t USART_WordLength;
+    uint16_t USART_StopBits;
+    uint16_t USART_Parity;
+    uint16_t USART_Mode;
+    uint16_t USART_HardwareFlowControl;
+} USART_InitTypeDef;
+
+#define USART_WordLength_8b ((uint16_t)0x0000)
+#define USART_StopBits_1 ((uint16_t)0x0000)
+#define USART_Parity_No ((uint16_t)0x0000)
+#define USART_Mode_Rx ((uint16_t)0x0004)
+#define USART_Mode_Tx ((uint16_t)0x0008)
+#define USART_HardwareFlowControl_None ((uint16_t)0x0000)
+#define USART_FLAG_RXNE ((uint16_t)0x0020)
+#define USART_FLAG_ORE ((uint16_t)0x0008)
+#define USART_DMAReq_Rx ((uint16_t)0x0040)
+
+void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct);
+void USART_DeInit(USART_TypeDef *USARTx);
+void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState);
+void USART_HalfDuplexCmd(USART_TypeDef *USARTx, FunctionalState NewState);
+FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG);
+uint16_t USART_ReceiveData(USART_TypeDef *USARTx);
+void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState);
+
+//
+// I2C (there is no device model behind it; every polled event "completes"
+// and the interrupt driven master sees only the STAR1 values a test
+// stores before calling its handlers)
+//
+typedef struct {
+    uint32_t I2C_ClockSpeed;
+    uint16_t I2C_Mode;
+    uint16_t I2C_DutyCycle;
+    uint16_t I2C_OwnAddress1;
+    uint16_t I2C_Ack;
+    uint16_t I2C_AcknowledgedAddress;
+} I2C_InitTypeDef;
+
+#define I2C_Mode_I2C ((uint16_t)0x0000)
+#define I2C_DutyCycle_16_9 ((uint16_t)0x4000)
+#define I2C_Ack_Enable ((uint16_t)0x0400)
+#define I2C_AcknowledgedAddress_7bit ((uint16_t)0x4000)
+#define I2C_Direction_Transmitter ((uint8_t)0x00)
+#define I2C_Direction_Receiver ((uint8_t)0x01)
+#define I2C_EVENT_MASTER_MODE_SELECT ((uint32_t)0x00030001)
+#define I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED ((uint32_t)0x00070082)
+#define I2C_EVENT_MASTER_RECEIVER_MODE_SELECTED ((uint32_t)0x00030002)
+#define I2C_EVENT_MASTER_BYTE_TRANSMITTED ((uint32_t)0x00070084)
+#define I2C_FLAG_BUSY ((uint32_t)0x00020000)
+#define I2C_FLAG_TXE ((uint32_t)0x10000080)
+#define I2C_FLAG_RXNE ((uint32_t)0x10000040)
+#define I2C_IT_BUF ((uint16_t)0x0400)
+#define I2C_IT_EVT ((uint16_t)0x0200)
+#define I2C_IT_ERR ((uint16_t)0x0100)
+#define I2C_CTLR1_PE ((uint16_t)0x0001)
+#define I2C_CTLR1_START ((uint16_t)0x0100)
+#define I2C_CTLR1_STOP ((uint16_t)0x0200)
+#define I2C_CTLR1_ACK ((uint16_t)0x0400)
+#define I2C_CTLR1_SWRST ((uint16_t)0x8000)
+#define I2C_STAR1_SB ((uint16_t)0x0001)
+#define I2C_STAR1_ADDR ((uint16_t)0x0002)
+#define I2C_STAR1_BTF ((uint16_t)0x0004)
+#define I2C_STAR1_RXNE ((uint16_t)0x0040)
+#define I2C_STAR1_TXE ((uint16_t)0x0080)
+#define I2C_STAR1_BERR ((uint16_t)0x0100)
+#define I2C_STAR1_ARLO ((uint16_t)0x0200)
+#define I2C_STAR1_AF ((uint16_t)0x0400)
+#define I2C_STAR1_OVR ((uint16_t)0x0800)
+
+void I2C_Init(I2C_TypeDef *I2Cx, I2C_InitTypeDef *I2C_InitStruct);
+void I2C_DeInit(I2C_TypeDef *I2Cx);
+void I2C_Cmd(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_AcknowledgeConfig(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_GenerateSTART(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_GenerateSTOP(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_Send7bitAddress(I2C_TypeDef *I2Cx, uint8_t Address, uint8_t I2C_Direction);
+void I2C_SendData(I2C_TypeDef *I2Cx, uint8_t Data);
+uint8_t I2C_ReceiveData(I2C_TypeDef *I2Cx);
+int I2C_CheckEvent(I2C_TypeDef *I2Cx, uint32_t I2C_EVENT);
+FlagStatus I2C_GetFlagStatus(I2C_TypeDef *I2Cx, uint32_t I2C_FLAG);
+void I2C_ITConfig(I2C_TypeDef *I2Cx, uint16_t I2C_IT, FunctionalState NewState);
+void I2C_SoftwareResetCmd(I2C_TypeDef *I2Cx, FunctionalState NewState);
+
+//
+// EXTI / PWR
+//
+typedef enum {EXTI_Mode_Interrupt = 0x00, EXTI_Mode_Event = 0x04} EXTIMode_TypeDef;
+typedef enum {EXTI_Trigger_Rising = 0x08, EXTI_Trigger_Falling = 0x0C} EXTITrigger_TypeDef;
+typedef struct {
+    uint32_t EXTI_Line;
+    EXTIMode_TypeDef EXTI_Mode;
+    EXTITrigger_TypeDef EXTI_Trigger;
+    FunctionalState EXTI_LineCmd;
+} EXTI_InitTypeDef;
+#define EXTI_Line9 ((uint32_t)0x00200)
+
+void EXTI_Init(EXTI_InitTypeDef *EXTI_InitStruct);
+
+#endif /* HOST_DEBUG_H_ */
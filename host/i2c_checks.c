@@ -0,0 +1,236 @@
+//
+// i2c_checks.c
+// Behavior checks of the interrupt driven I2C master (Arduino.c built
+// with BITBANG=0). There is no slave model behind the simulated I2C1;
+// each check plays the peripheral by storing the STAR1 value of the next
+// event and calling the interrupt handler the way the core would (with
+// interrupts masked), then looks at what the driver asked I2C1 to do
+//
+// Host build:
+//   gcc -O2 -Wall -DBITBANG=0 -Ihost -I. Arduino.c spi_lcd.c host/lcd_sim.c host/i2c_checks.c -o i2c_checks
+// usage: i2c_checks (the exit code is the number of failed checks)
+//
+// Copyright 2023 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#include "Arduino.h"
+#include "spi_lcd.h"
+#include "lcd_sim.h"
+
+#if BITBANG
+#error "build with -DBITBANG=0; these checks need the I2C1 interrupt engine"
+#endif
+
+#define I2C_ALL_IT (I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR)
+
+void I2C1_EV_IRQHandler(void);
+void I2C1_ER_IRQHandler(void);
+
+static int iUnmasked; // handlers which returned with interrupts enabled
+static I2CTRANSACTION *pNextPoll; // submitted by checkChainPoll()
+
+static void checkStart(void)
+{
+	lcdSimInit(LCD_ST7735_80x160, 0xa4, 0xa3); // resets SysTick and MIE
+	I2CInit(0xb7, 0xb6, 400000);
+	iUnmasked = 0;
+} /* checkStart() */
+
+//
+// Raise one I2C1 event; the core masks interrupts on entry to the
+// handler and mret puts the previous state back
+//
+static void checkEvent(uint16_t u16Status, int bError)
+{
+	uint32_t u32Saved = __get_MSTATUS();
+
+	I2C1->STAR1 = u16Status;
+	__disable_irq();
+	if (bError)
+		I2C1_ER_IRQHandler();
+	else
+		I2C1_EV_IRQHandler();
+	iUnmasked += ((__get_MSTATUS() & 0x8) != 0);
+	__set_MSTATUS(u32Saved);
+	I2C1->STAR1 = 0;
+} /* checkEvent() */
+
+//
+// Returns 1 if the driver set the CTLR1 bits and clears them, as I2C1
+// does once it has generated the START or STOP
+//
+static int checkTake(uint16_t u16Bits)
+{
+	int bSet = ((I2C1->CTLR1 & u16Bits) == u16Bits);
+
+	I2C1->CTLR1 &= ~u16Bits;
+	return bSet;
+} /* checkTake() */
+
+//
+// Completion callback which submits the next transaction of a polling
+// chain from inside the I2C interrupt
+//
+static void checkChainPoll(I2CTRANSACTION *pTrans)
+{
+	(void)pTrans;
+	I2CSubmit(pNextPoll);
+} /* checkChainPoll() */
+
+//
+// Address-only transaction (like I2CTest()) which is already running
+//
+static int checkFinishProbe(I2CTRANSACTION *pTrans)
+{
+	int iBad = !checkTake(I2C_CTLR1_START);
+
+	checkEvent(I2C_STAR1_SB, 0);
+	iBad += (I2C1->DATAR != (pTrans->u8Addr << 1));
+	checkEvent(I2C_STAR1_ADDR, 0);
+	iBad += !checkTake(I2C_CTLR1_STOP) + (pTrans->iStatus != I2C_STATUS_OK);
+	return iBad;
+} /* checkFinishProbe() */
+
+//
+// Register read: write the register number, repeated START, read two
+// bytes (ACK the first, NACK + STOP for the last)
+//
+static int checkWriteRead(void)
+{
+	I2CTRANSACTION t = {0};
+	I2CSTATS stats;
+	uint8_t u8Reg = 0x10, u8Data[2] = {0};
+	int iBad;
+
+	checkStart();
+	t.u8Addr = 0x50;
+	t.pWrite = &u8Reg; t.iWriteLen = 1;
+	t.pRead = u8Data; t.iReadLen = 2;
+	iBad = (I2CSubmit(&t) != 0) + (t.iStatus != I2C_STATUS_BUSY);
+	iBad += !checkTake(I2C_CTLR1_START) + (I2C1->CTLR2 != I2C_ALL_IT);
+	checkEvent(I2C_STAR1_SB, 0);
+	iBad += (I2C1->DATAR != 0xa0); // address + write
+	checkEvent(I2C_STAR1_ADDR, 0);
+	checkEvent(I2C_STAR1_TXE, 0);
+	iBad += (I2C1->DATAR != 0x10) + ((I2C1->CTLR2 & I2C_IT_BUF) != 0); // BTF next
+	checkEvent(I2C_STAR1_TXE | I2C_STAR1_BTF, 0);
+	iBad += !checkTake(I2C_CTLR1_START) + ((I2C1->CTLR2 & I2C_IT_BUF) == 0);
+	iBad += (I2C1->CTLR1 & I2C_CTLR1_STOP) != 0;
+	checkEvent(I2C_STAR1_SB, 0);
+	iBad += (I2C1->DATAR != 0xa1); // address + read
+	checkEvent(I2C_STAR1_ADDR, 0);
+	iBad += (I2C1->CTLR1 & I2C_CTLR1_ACK) == 0;
+	I2C1->DATAR = 0x12;
+	checkEvent(I2C_STAR1_RXNE, 0);
+	iBad += (I2C1->CTLR1 & I2C_CTLR1_ACK) != 0; // NACK the last byte
+	iBad += !checkTake(I2C_CTLR1_STOP) + (t.iStatus != I2C_STATUS_BUSY);
+	I2C1->DATAR = 0x34;
+	checkEvent(I2C_STAR1_RXNE, 0);
+	iBad += (t.iStatus != I2C_STATUS_OK) + (u8Data[0] != 0x12) + (u8Data[1] != 0x34);
+	iBad += (I2C1->CTLR2 != 0); // queue empty; interrupts off
+	I2CGetStats(&stats);
+	iBad += (stats.u32Bytes != 3) + (stats.u32Nacks != 0) + iUnmasked;
+	return iBad;
+} /* checkWriteRead() */
+
+//
+// NACK: the slave refuses its address; the completion callback submits
+// the next poll from the interrupt, which must not unmask interrupts
+//
+static int checkNack(void)
+{
+	I2CTRANSACTION t = {0}, tNext = {0};
+	I2CSTATS stats;
+	uint8_t u8Cmd = 0;
+	int iBad;
+
+	checkStart();
+	t.u8Addr = 0x3c;
+	t.pWrite = &u8Cmd; t.iWriteLen = 1;
+	t.pfnDone = checkChainPoll;
+	tNext.u8Addr = 0x3d;
+	pNextPoll = &tNext;
+	iBad = (I2CSubmit(&t) != 0) + !checkTake(I2C_CTLR1_START);
+	checkEvent(I2C_STAR1_SB, 0);
+	checkEvent(I2C_STAR1_AF, 1);
+	iBad += (t.iStatus != I2C_STATUS_NACK) + !checkTake(I2C_CTLR1_STOP);
+	iBad += (tNext.iStatus != I2C_STATUS_BUSY) + (I2C1->CTLR2 != I2C_ALL_IT);
+	iBad += checkFinishProbe(&tNext);
+	I2CGetStats(&stats);
+	iBad += (stats.u32Nacks != 1) + (stats.u32Errors != 0) + (I2C1->CTLR2 != 0);
+	iBad += iUnmasked + ((__get_MSTATUS() & 0x8) == 0);
+	return iBad;
+} /* checkNack() */
+
+//
+// Timeout: a slave which never answers is abandoned by I2CService()
+// after its timeout, the bus is recovered, and the queued transaction
+// behind it starts
+//
+static int checkTimeout(void)
+{
+	I2CTRANSACTION t = {0}, tNext = {0};
+	I2CSTATS stats;
+	uint8_t u8Cmd = 0;
+	uint64_t u64Start;
+	int iBad;
+
+	checkStart();
+	t.u8Addr = 0x20;
+	t.pWrite = &u8Cmd; t.iWriteLen = 1;
+	t.u32TimeoutUs = 200;
+	tNext.u8Addr = 0x21;
+	u64Start = lcdSimTimeNs();
+	iBad = (I2CSubmit(&t) != 0) + (I2CSubmit(&tNext) != 0);
+	iBad += !checkTake(I2C_CTLR1_START) + (tNext.iStatus != I2C_STATUS_QUEUED);
+	checkEvent(I2C_STAR1_SB, 0); // then nothing more
+	I2CService();
+	iBad += (t.iStatus != I2C_STATUS_BUSY); // too early
+	iBad += (I2CWaitTransaction(&t) != I2C_STATUS_TIMEOUT);
+	iBad += (lcdSimTimeNs() - u64Start < 200000);
+	iBad += (I2C1->CTLR1 & I2C_CTLR1_SWRST) != 0; // out of reset again
+	iBad += (tNext.iStatus != I2C_STATUS_BUSY) + (I2C1->CTLR2 != I2C_ALL_IT);
+	iBad += ((__get_MSTATUS() & 0x8) == 0); // interrupts enabled again
+	iBad += checkFinishProbe(&tNext);
+	I2CGetStats(&stats);
+	iBad += (stats.u32Timeouts != 1) + (I2C1->CTLR2 != 0) + iUnmasked;
+	return iBad;
+} /* checkTimeout() */
+
+typedef struct check_tag {
+	const char *szName;
+	int (*pfnCheck)(void); // returns the number of errors
+} CHECK;
+
+static const CHECK checks[] = {
+	{"write + read", checkWriteRead},
+	{"NACK + chained poll", checkNack},
+	{"timeout + queue advance", checkTimeout},
+};
+
+int main(int argc, char *argv[])
+{
+	int i, iErrors, iFailed = 0;
+
+	(void)argc; (void)argv;
+	for (i=0; i<(int)(sizeof(checks) / sizeof(checks[0])); i++) {
+		iErrors = (*checks[i].pfnCheck)();
+		printf("%-24s %s", checks[i].szName, iErrors ? "FAIL" : "ok");
+		if (iErrors)
+			printf(" (%d errors)", iErrors);
+		printf("\n");
+		if (iErrors)
+			iFailed++;
+	}
+	printf("%d of %d checks failed\n", iFailed, i);
+	return iFailed;
+} /* main() */
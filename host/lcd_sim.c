@@ -0,0 +1,858 @@
+//
+// lcd_sim.c
+// Host (Linux) stand-in for the WCH peripheral library calls made by
+// Arduino.c and spi_lcd.c. Bytes written to SPI1 (polled or by DMA channel 3)
+// are fed to a virtual LCD controller which decodes the command stream into
+// its own GRAM. DMA transfers complete immediately and call the real
+// DMA1_Channel3_IRQHandler() from spi_lcd.c, so the driver runs unmodified.
+//
+// Build example:
+//   gcc -O2 -Wall -Ihost -I. Arduino.c spi_lcd.c host/lcd_sim.c host/sim_main.c -o lcd_sim
+//
+// Copyright 2023 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#include "Arduino.h"
+#include "spi_lcd.h"
+#include "lcd_sim.h"
+
+uint32_t SystemCoreClock = 144000000; // CH32V203 at full speed
+
+GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC, sim_GPIOD;
+SPI_TypeDef sim_SPI1;
+DMA_TypeDef sim_DMA1;
+DMA_Channel_TypeDef sim_DMA1_Channel3, sim_DMA1_Channel5;
+USART_TypeDef sim_USART1;
+I2C_TypeDef sim_I2C1;
+AFIO_TypeDef sim_AFIO;
+SysTick_Type sim_SysTick;
+uint32_t sim_MSTATUS = 0x88; // interrupts enabled
+
+void DMA1_Channel3_IRQHandler(void);
+void DMA1_Channel5_IRQHandler(void);
+
+// SPI1 control bits
+#define SPI_CTLR1_DFF 0x0800
+#define SPI_CTLR2_TXDMAEN 0x0002
+// DMA channel configuration bits
+#define DMA_CFGR_TCIE 0x0002
+#define DMA_CFGR_MINC 0x0080
+#define DMA_CFGR_MSIZE 0x0c00
+
+// Controller commands understood by the virtual panel
+#define CMD_SWRESET 0x01
+#define CMD_SLPOUT 0x11
+#define CMD_INVOFF 0x20
+#define CMD_INVON 0x21
+#define CMD_DISPON 0x29
+#define CMD_CASET 0x2a
+#define CMD_RASET 0x2b
+#define CMD_RAMWR 0x2c
+#define CMD_VSCRDEF 0x33
+#define CMD_MADCTL 0x36
+#define CMD_VSCRSADD 0x37
+#define CMD_COLMOD 0x3a
+#define CMD_RAMWRC 0x3c
+
+// Datasheet minimums checked by the virtual panel (ST7735S/ST7789V/GC9107)
+#define SIM_RESET_PULSE_NS 10000ULL      // RESX low
+#define SIM_RESET_READY_NS 5000000ULL    // from reset until the next command
+#define SIM_SLEEPOUT_READY_NS 120000000ULL // from reset until SLPOUT
+
+#define MAX_GRAM_WIDTH 240
+#define MAX_GRAM_HEIGHT 320
+
+//
+// Physical GRAM size of each controller and the part of it which is
+// visible on the glass, expressed as the window which spi_lcd.c addresses
+// after lcdInit() (its ORIENTATION_0 MADCTL value and offsets)
+//
+typedef struct sim_panel_tag {
+	int iGRAMWidth, iGRAMHeight; // controller memory (portrait)
+	int iViewWidth, iViewHeight;
+	int iViewXOff, iViewYOff;
+	uint8_t u8ViewMADCTL;
+	uint32_t u32SleepOutUs; // from SLPOUT until the next command
+} SIMPANEL;
+
+static const SIMPANEL simPanels[LCD_COUNT] = {
+	{132, 162, 160, 80, 0, 24, 0x68, 5000},  // LCD_ST7735_80x160
+	{132, 162, 160, 80, 1, 26, 0x68, 5000},  // LCD_ST7735_80x160_B
+	{132, 162, 128, 128, 1, 0, 0x68, 5000},  // LCD_ST7735_128x128
+	{132, 162, 160, 128, 0, 0, 0x60, 5000},  // LCD_ST7735_128x160
+	{240, 320, 240, 135, 40, 53, 0x60, 5000}, // LCD_ST7789_135x240
+	{240, 320, 320, 172, 0, 34, 0x60, 5000}, // LCD_ST7789_172x320
+	{240, 320, 240, 240, 0, 0, 0x60, 5000},  // LCD_ST7789_240x240
+	{240, 320, 280, 240, 20, 0, 0x60, 5000}, // LCD_ST7789_240x280
+	{240, 320, 320, 240, 0, 0, 0x60, 5000},  // LCD_ST7789_240x320
+	{128, 160, 128, 128, 1, 2, 0x68, 120000} // LCD_GC9107_128x128
+};
+
+static const SIMPANEL *pPanel = &simPanels[0];
+static uint16_t u16GRAM[MAX_GRAM_WIDTH * MAX_GRAM_HEIGHT];
+static LCDSIMSTATS simStats;
+static uint64_t u64SimTime;
+static uint64_t u64TickFrac; // SysTick ticks x 1e9 not yet counted
+static GPIO_TypeDef *pCSPort, *pDCPort, *pRSTPort;
+static uint16_t u16CSMask, u16DCMask, u16RSTMask;
+static int bCSLow, bRSTLow, bRSTFell;
+// end of the last reset pulse/SWRESET and of the last SLPOUT
+static uint64_t u64ResetNs, u64RSTLowNs, u64SleepOutNs;
+static int bResetSeen, bSleepOutSeen;
+// controller state
+static uint8_t u8Cmd, u8MADCTL, u8Params[16];
+static int iParam, iPixelPhase;
+static uint16_t u16PixelHi;
+static int iColStart, iColEnd, iRowStart, iRowEnd, iCol, iRow;
+static int iScrollTop, iScrollHeight, iScrollStart; // TFA, VSA and SSA (GRAM rows)
+// DMA completion nesting (the ISR may start the next transfer)
+static int iDMANest, bDMARestart;
+// DMA1_Channel3 interrupt enable (NVIC) and a completion waiting for it
+static int bDMAIRQEnabled, bDMAIRQPending;
+// USART1 receive DMA (channel 5): interrupt enable and the CNTR reload value
+static int bRxIRQEnabled;
+static uint32_t u32RxReload;
+
+static GPIO_TypeDef *simPort(uint8_t u8Pin)
+{
+	switch (u8Pin & 0xf0) {
+	case 0xa0: return GPIOA;
+	case 0xb0: return GPIOB;
+	case 0xc0: return GPIOC;
+	case 0xd0: return GPIOD;
+	}
+	return NULL;
+} /* simPort() */
+
+//
+// Convert a controller (column, row) address under the given MADCTL value
+// into a physical GRAM offset; returns -1 if it falls outside the GRAM
+//
+static int simGRAMOffset(uint8_t u8Mode, int c, int r)
+{
+	int iMaxC, iMaxR;
+
+	if (u8Mode & MADCTL_VFLIP) { // row/column exchange
+		iMaxC = pPanel->iGRAMHeight - 1;
+		iMaxR = pPanel->iGRAMWidth - 1;
+	} else {
+		iMaxC = pPanel->iGRAMWidth - 1;
+		iMaxR = pPanel->iGRAMHeight - 1;
+	}
+	if (c < 0 || c > iMaxC || r < 0 || r > iMaxR) return -1;
+	if (u8Mode & MADCTL_XFLIP) c = iMaxC - c;
+	if (u8Mode & MADCTL_YFLIP) r = iMaxR - r;
+	if (u8Mode & MADCTL_VFLIP)
+		return (c * pPanel->iGRAMWidth) + r;
+	return (r * pPanel->iGRAMWidth) + c;
+} /* simGRAMOffset() */
+
+static void simResetController(void)
+{
+	u8Cmd = 0;
+	u8MADCTL = 0;
+	iParam = iPixelPhase = 0;
+	iColStart = iRowStart = iCol = iRow = 0;
+	iColEnd = pPanel->iGRAMWidth - 1;
+	iRowEnd = pPanel->iGRAMHeight - 1;
+	iScrollTop = iScrollStart = 0;
+	iScrollHeight = pPanel->iGRAMHeight;
+} /* simResetController() */
+
+static void simWritePixel(uint16_t u16Pixel)
+{
+	int iOffset = simGRAMOffset(u8MADCTL, iCol, iRow);
+
+	if (iOffset >= 0)
+		u16GRAM[iOffset] = u16Pixel;
+	simStats.u32Pixels++;
+	if (++iCol > iColEnd) {
+		iCol = iColStart;
+		if (++iRow > iRowEnd)
+			iRow = iRowStart;
+	}
+} /* simWritePixel() */
+
+//
+// Count commands which arrive sooner after a reset or SLPOUT than the
+// controller can accept them
+//
+static void simCheckTiming(uint8_t u8)
+{
+	if (bResetSeen && u64SimTime - u64ResetNs < SIM_RESET_READY_NS)
+		simStats.u32TimingErrors++;
+	else if (u8 == CMD_SLPOUT && bResetSeen && u64SimTime - u64ResetNs < SIM_SLEEPOUT_READY_NS)
+		simStats.u32TimingErrors++;
+	else if (bSleepOutSeen && u64SimTime - u64SleepOutNs < (uint64_t)pPanel->u32SleepOutUs * 1000)
+		simStats.u32TimingErrors++;
+	if (u8 == CMD_SWRESET) {
+		u64ResetNs = u64SimTime;
+		bResetSeen = 1;
+		bSleepOutSeen = 0;
+	} else if (u8 == CMD_SLPOUT) {
+		u64SleepOutNs = u64SimTime;
+		bSleepOutSeen = 1;
+	}
+} /* simCheckTiming() */
+
+static void simCommand(uint8_t u8)
+{
+	simCheckTiming(u8);
+	simStats.u32CmdBytes++;
+	simStats.u32Cmds[u8]++;
+	u8Cmd = u8;
+	iParam = iPixelPhase = 0;
+	switch (u8) {
+	case CMD_SWRESET:
+		simResetController();
+		break;
+	case CMD_RAMWR:
+		iCol = iColStart;
+		iRow = iRowStart;
+		break;
+	}
+} /* simCommand() */
+
+static void simData(uint8_t u8)
+{
+	simStats.u32DataBytes++;
+	if (u8Cmd == CMD_RAMWR || u8Cmd == CMD_RAMWRC) {
+		if (iPixelPhase == 0) {
+			u16PixelHi = u8;
+			iPixelPhase = 1;
+		} else {
+			simWritePixel((u16PixelHi << 8) | u8);
+			iPixelPhase = 0;
+		}
+		return;
+	}
+	if (iParam >= (int)sizeof(u8Params)) return;
+	u8Params[iParam++] = u8;
+	switch (u8Cmd) {
+	case CMD_CASET:
+		if (iParam == 4) {
+			iColStart = (u8Params[0] << 8) | u8Params[1];
+			iColEnd = (u8Params[2] << 8) | u8Params[3];
+		}
+		break;
+	case CMD_RASET:
+		if (iParam == 4) {
+			iRowStart = (u8Params[0] << 8) | u8Params[1];
+			iRowEnd = (u8Params[2] << 8) | u8Params[3];
+		}
+		break;
+	case CMD_MADCTL:
+		u8MADCTL = u8Params[0];
+		break;
+	case CMD_VSCRDEF: // the bottom fixed area is whatever is left
+		if (iParam == 4) {
+			iScrollTop = (u8Params[0] << 8) | u8Params[1];
+			iScrollHeight = (u8Params[2] << 8) | u8Params[3];
+		}
+		break;
+	case CMD_VSCRSADD:
+		if (iParam == 2)
+			iScrollStart = (u8Params[0] << 8) | u8Params[1];
+		break;
+	}
+} /* simData() */
+
+static uint32_t simSCKHz(void)
+{
+	return SystemCoreClock >> (((SPI1->CTLR1 >> 3) & 7) + 1);
+} /* simSCKHz() */
+
+//
+// Move the simulated clock (and SysTick, when it's running) forward
+// SysTick counts at HCLK with STCLK set, HCLK/8 otherwise
+//
+static void simAdvance(uint64_t u64Ns)
+{
+	uint64_t u64Ticks;
+
+	u64SimTime += u64Ns;
+	if (sim_SysTick.CTLR & 1) {
+		u64TickFrac += u64Ns * ((sim_SysTick.CTLR & 4) ? SystemCoreClock : SystemCoreClock / 8);
+		u64Ticks = u64TickFrac / 1000000000ULL;
+		u64TickFrac -= u64Ticks * 1000000000ULL;
+		if (sim_SysTick.CTLR & 0x10) // counting down
+			sim_SysTick.CNT -= u64Ticks;
+		else
+			sim_SysTick.CNT += u64Ticks;
+	}
+} /* simAdvance() */
+
+//
+// Core timer access; a few CPU cycles pass each time
+//
+SysTick_Type *simSysTick(void)
+{
+	simAdvance((4000000000ULL + SystemCoreClock - 1) / SystemCoreClock);
+	return &sim_SysTick;
+} /* simSysTick() */
+
+//
+// One byte leaves the MOSI pin; the panel only listens while CS is low
+//
+static void simSPIByte(uint8_t u8)
+{
+	uint64_t u64Ns = 8000000000ULL / simSCKHz();
+
+	simStats.u32Bytes++;
+	simStats.u64SPITimeNs += u64Ns;
+	simAdvance(u64Ns);
+	if (!bCSLow) return;
+	if (pDCPort && (pDCPort->OUTDR & u16DCMask))
+		simData(u8);
+	else
+		simCommand(u8);
+} /* simSPIByte() */
+
+static void simGPIOChanged(GPIO_TypeDef *GPIOx)
+{
+	int bLow;
+
+	if (GPIOx == pRSTPort) {
+		bLow = ((GPIOx->OUTDR & u16RSTMask) == 0);
+		if (bLow && !bRSTLow) {
+			u64RSTLowNs = u64SimTime;
+			bRSTFell = 1;
+		} else if (!bLow && bRSTLow && bRSTFell) { // the end of a reset pulse
+			if (u64SimTime - u64RSTLowNs < SIM_RESET_PULSE_NS)
+				simStats.u32TimingErrors++;
+			simResetController();
+			u64ResetNs = u64SimTime;
+			bResetSeen = 1;
+			bSleepOutSeen = 0;
+		}
+		bRSTLow = bLow;
+	}
+	if (GPIOx != pCSPort) return;
+	bLow = ((GPIOx->OUTDR & u16CSMask) == 0);
+	if (bCSLow && !bLow)
+		simStats.u32Transactions++;
+	bCSLow = bLow;
+} /* simGPIOChanged() */
+
+//
+// Virtual panel API
+//
+void lcdSimInit(int iLCDType, uint8_t u8CSPin, uint8_t u8DCPin)
+{
+	if (iLCDType < 0 || iLCDType >= LCD_COUNT) return;
+	pPanel = &simPanels[iLCDType];
+	pCSPort = simPort(u8CSPin);
+	u16CSMask = GPIO_Pin_0 << (u8CSPin & 0xf);
+	pDCPort = simPort(u8DCPin);
+	u16DCMask = GPIO_Pin_0 << (u8DCPin & 0xf);
+	bCSLow = (pCSPort && (pCSPort->OUTDR & u16CSMask) == 0);
+	memset(u16GRAM, 0, sizeof(u16GRAM));
+	simResetController();
+	u64SimTime = u64TickFrac = 0;
+	pRSTPort = NULL;
+	bResetSeen = bSleepOutSeen = 0;
+	memset(&sim_SysTick, 0, sizeof(sim_SysTick)); // HCLK/8, stopped
+	sim_MSTATUS = 0x88;
+	lcdSimResetStats();
+} /* lcdSimInit() */
+
+//
+// Watch the controller's reset line too; its pulses then reset the
+// virtual controller and are checked against the datasheet timing
+//
+void lcdSimSetResetPin(uint8_t u8Pin)
+{
+	pRSTPort = simPort(u8Pin);
+	u16RSTMask = GPIO_Pin_0 << (u8Pin & 0xf);
+	bRSTLow = (pRSTPort && (pRSTPort->OUTDR & u16RSTMask) == 0);
+	bRSTFell = 0; // a line which was never driven low didn't reset anything
+} /* lcdSimSetResetPin() */
+
+void lcdSimResetStats(void)
+{
+	memset(&simStats, 0, sizeof(simStats));
+} /* lcdSimResetStats() */
+
+void lcdSimGetStats(LCDSIMSTATS *pStats)
+{
+	memcpy(pStats, &simStats, sizeof(simStats));
+} /* lcdSimGetStats() */
+
+void lcdSimPrintStats(const char *szLabel)
+{
+	printf("%-24s %8u bytes (%u cmd, %u data) %7u pixels %6u CS frames %5u DMA, CASET/RASET/RAMWR %u/%u/%u, SPI %llu us\n",
+		szLabel, simStats.u32Bytes, simStats.u32CmdBytes, simStats.u32DataBytes,
+		simStats.u32Pixels, simStats.u32Transactions, simStats.u32DMATransfers,
+		simStats.u32Cmds[CMD_CASET], simStats.u32Cmds[CMD_RASET], simStats.u32Cmds[CMD_RAMWR],
+		(unsigned long long)(simStats.u64SPITimeNs / 1000));
+} /* lcdSimPrintStats() */
+
+uint64_t lcdSimTimeNs(void)
+{
+	return u64SimTime;
+} /* lcdSimTimeNs() */
+
+void lcdSimGetSize(int *pWidth, int *pHeight)
+{
+	*pWidth = pPanel->iViewWidth;
+	*pHeight = pPanel->iViewHeight;
+} /* lcdSimGetSize() */
+
+void lcdSimGetWindow(int *pCol, int *pRow, uint8_t *pMADCTL)
+{
+	*pCol = iColStart;
+	*pRow = iRowStart;
+	*pMADCTL = u8MADCTL;
+} /* lcdSimGetWindow() */
+
+uint16_t lcdSimGetPixel(int x, int y)
+{
+	int iOffset, iLine;
+
+	if (x < 0 || y < 0 || x >= pPanel->iViewWidth || y >= pPanel->iViewHeight)
+		return 0;
+	iOffset = simGRAMOffset(pPanel->u8ViewMADCTL, x + pPanel->iViewXOff, y + pPanel->iViewYOff);
+	if (iOffset < 0) return 0;
+	// the glass shows GRAM rows in order, except for the scrolling area
+	// which starts showing at row iScrollStart and wraps around
+	iLine = iOffset / pPanel->iGRAMWidth;
+	if (iLine >= iScrollTop && iLine < iScrollTop + iScrollHeight && iScrollHeight > 0) {
+		iLine = iScrollTop + (iLine - iScrollTop + iScrollStart - iScrollTop + iScrollHeight) % iScrollHeight;
+		iOffset = (iLine * pPanel->iGRAMWidth) + (iOffset % pPanel->iGRAMWidth);
+	}
+	return u16GRAM[iOffset];
+} /* lcdSimGetPixel() */
+
+int lcdSimDumpPPM(const char *szFile)
+{
+	FILE *f;
+	int x, y;
+	uint16_t u16;
+	uint8_t rgb[3];
+
+	f = fopen(szFile, "wb");
+	if (f == NULL) return -1;
+	fprintf(f, "P6\n%d %d\n255\n", pPanel->iViewWidth, pPanel->iViewHeight);
+	for (y = 0; y < pPanel->iViewHeight; y++) {
+		for (x = 0; x < pPanel->iViewWidth; x++) {
+			u16 = lcdSimGetPixel(x, y);
+			rgb[0] = ((u16 >> 8) & 0xf8) | (u16 >> 13);
+			rgb[1] = ((u16 >> 3) & 0xfc) | ((u16 >> 9) & 3);
+			rgb[2] = ((u16 << 3) & 0xf8) | ((u16 >> 2) & 7);
+			fwrite(rgb, 1, 3, f);
+		}
+	}
+	fclose(f);
+	return 0;
+} /* lcdSimDumpPPM() */
+
+//
+// Timing
+//
+//
+// Same register sequence as the WCH SDK: CMP assumes SysTick runs at
+// HCLK/8 and the delay lasts as long as SysTick really takes to count
+// it down, so a wrongly configured SysTick shows up as short delays
+//
+static void simDelayTicks(uint64_t u64Ticks)
+{
+	uint32_t u32Hz = (sim_SysTick.CTLR & 4) ? SystemCoreClock : SystemCoreClock / 8;
+	uint64_t u64Ns;
+
+	sim_SysTick.SR &= ~1;
+	sim_SysTick.CMP = u64Ticks;
+	sim_SysTick.CTLR |= 0x10; // count down
+	sim_SysTick.CTLR |= 1; // with INIT: CNT = CMP
+	sim_SysTick.CNT = sim_SysTick.CMP;
+	u64Ns = (u64Ticks * 1000000000ULL + u32Hz - 1) / u32Hz;
+	simStats.u64DelayNs += u64Ns;
+	simAdvance(u64Ns);
+	sim_SysTick.CNT = 0;
+	sim_SysTick.SR |= 1;
+	sim_SysTick.CTLR &= ~1;
+} /* simDelayTicks() */
+
+void Delay_Us(uint32_t n)
+{
+	simDelayTicks((uint64_t)n * (SystemCoreClock / 8000000));
+}
+
+void Delay_Ms(uint32_t n)
+{
+	simDelayTicks((uint64_t)n * (SystemCoreClock / 8000));
+}
+
+//
+// RCC
+//
+void RCC_AHBPeriphClockCmd(uint32_t u32Periph, FunctionalState NewState) { (void)u32Periph; (void)NewState; }
+void RCC_APB2PeriphClockCmd(uint32_t u32Periph, FunctionalState NewState) { (void)u32Periph; (void)NewState; }
+void RCC_APB1PeriphClockCmd(uint32_t u32Periph, FunctionalState NewState) { (void)u32Periph; (void)NewState; }
+void RCC_APB1PeriphResetCmd(uint32_t u32Periph, FunctionalState NewState) { (void)u32Periph; (void)NewState; }
+void RCC_LSICmd(FunctionalState NewState) { (void)NewState; }
+FlagStatus RCC_GetFlagStatus(uint8_t u8Flag) { (void)u8Flag; return SET; }
+
+//
+// GPIO
+//
+//
+// Open-drain outputs (CNF=01 with a MODE speed) of a port, from CFGLR/CFGHR
+//
+static uint16_t simGPIOOpenDrain(GPIO_TypeDef *GPIOx)
+{
+	int i;
+	uint32_t u32Cfg;
+	uint16_t u16Mask = 0;
+
+	for (i=0; i<16; i++) {
+		u32Cfg = ((i < 8) ? GPIOx->CFGLR : GPIOx->CFGHR) >> ((i & 7) * 4);
+		if ((u32Cfg & 3) && (u32Cfg & 0xc) == 4)
+			u16Mask |= (1 << i);
+	}
+	return u16Mask;
+} /* simGPIOOpenDrain() */
+
+void simGPIOWritten(GPIO_TypeDef *GPIOx)
+{
+	uint16_t u16OD;
+
+	// BSHR: upper half resets, lower half sets (set wins); BCR resets
+	GPIOx->OUTDR &= ~((GPIOx->BSHR >> 16) | GPIOx->BCR);
+	GPIOx->OUTDR |= (GPIOx->BSHR & 0xffff);
+	GPIOx->BSHR = GPIOx->BCR = 0;
+	// nothing else drives the simulated lines, so a released open-drain
+	// output reads back high (pull-up) and a driven one low
+	u16OD = simGPIOOpenDrain(GPIOx);
+	GPIOx->INDR = (GPIOx->INDR & ~u16OD) | (GPIOx->OUTDR & u16OD);
+	simGPIOChanged(GPIOx);
+} /* simGPIOWritten() */
+
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct)
+{
+	int i;
+	uint32_t u32Cfg;
+	__IO uint32_t *pCfg;
+
+	// 4 configuration bits per pin, like the real library writes them
+	u32Cfg = GPIO_InitStruct->GPIO_Mode & 0xf;
+	if (GPIO_InitStruct->GPIO_Mode & 0x10) // output
+		u32Cfg |= GPIO_InitStruct->GPIO_Speed;
+	for (i=0; i<16; i++) {
+		if (!(GPIO_InitStruct->GPIO_Pin & (1 << i))) continue;
+		pCfg = (i < 8) ? &GPIOx->CFGLR : &GPIOx->CFGHR;
+		*pCfg = (*pCfg & ~(0xf << ((i & 7) * 4))) | (u32Cfg << ((i & 7) * 4));
+	}
+	// inputs with a pull-up read back as 1
+	if (GPIO_InitStruct->GPIO_Mode == GPIO_Mode_IPU || GPIO_InitStruct->GPIO_Mode == GPIO_Mode_IN_FLOATING)
+		GPIOx->INDR |= GPIO_InitStruct->GPIO_Pin;
+	else if (GPIO_InitStruct->GPIO_Mode == GPIO_Mode_IPD)
+		GPIOx->INDR &= ~GPIO_InitStruct->GPIO_Pin;
+	simGPIOWritten(GPIOx);
+}
+
+void GPIO_DeInit(GPIO_TypeDef *GPIOx)
+{
+	memset(GPIOx, 0, sizeof(GPIO_TypeDef));
+	simGPIOChanged(GPIOx);
+}
+
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	return (GPIOx->INDR & GPIO_Pin) ? 1 : 0;
+}
+
+void GPIO_WriteBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, BitAction BitVal)
+{
+	if (BitVal != Bit_RESET)
+		GPIOx->OUTDR |= GPIO_Pin;
+	else
+		GPIOx->OUTDR &= ~GPIO_Pin;
+	simGPIOChanged(GPIOx);
+}
+
+void GPIO_PinRemapConfig(uint32_t GPIO_Remap, FunctionalState NewState) { (void)GPIO_Remap; (void)NewState; }
+
+//
+// SPI
+//
+void SPI_Init(SPI_TypeDef *SPIx, SPI_InitTypeDef *SPI_InitStruct)
+{
+	SPIx->CTLR1 = SPI_InitStruct->SPI_Direction | SPI_InitStruct->SPI_Mode |
+		SPI_InitStruct->SPI_DataSize | SPI_InitStruct->SPI_CPOL |
+		SPI_InitStruct->SPI_CPHA | SPI_InitStruct->SPI_NSS |
+		SPI_InitStruct->SPI_BaudRatePrescaler | SPI_InitStruct->SPI_FirstBit;
+}
+
+void SPI_Cmd(SPI_TypeDef *SPIx, FunctionalState NewState)
+{
+	if (NewState != DISABLE)
+		SPIx->CTLR1 |= CTLR1_SPE_Set;
+	else
+		SPIx->CTLR1 &= ~CTLR1_SPE_Set;
+}
+
+void SPI_I2S_DMACmd(SPI_TypeDef *SPIx, uint16_t SPI_I2S_DMAReq, FunctionalState NewState)
+{
+	if (NewState != DISABLE)
+		SPIx->CTLR2 |= SPI_I2S_DMAReq;
+	else
+		SPIx->CTLR2 &= ~SPI_I2S_DMAReq;
+}
+
+FlagStatus SPI_I2S_GetFlagStatus(SPI_TypeDef *SPIx, uint16_t SPI_I2S_FLAG)
+{
+	(void)SPIx;
+	// every write completes instantly: always empty, never busy
+	return (SPI_I2S_FLAG == SPI_I2S_FLAG_TXE) ? SET : RESET;
+}
+
+void SPI_I2S_SendData(SPI_TypeDef *SPIx, uint16_t Data)
+{
+	SPIx->DATAR = Data;
+	if (SPIx->CTLR1 & SPI_CTLR1_DFF) // 16-bit frames go out MSB first
+		simSPIByte((uint8_t)(Data >> 8));
+	simSPIByte((uint8_t)Data);
+}
+
+void SPI_DataSizeConfig(SPI_TypeDef *SPIx, uint16_t SPI_DataSize)
+{
+	SPIx->CTLR1 = (SPIx->CTLR1 & ~SPI_DataSize_16b) | SPI_DataSize;
+}
+
+//
+// DMA (only channel 3 -> SPI1 TX is modeled)
+//
+void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx)
+{
+	DMAy_Channelx->CFGR = 0;
+	DMAy_Channelx->CNTR = 0;
+	DMAy_Channelx->PADDR = 0;
+	DMAy_Channelx->MADDR = 0;
+}
+
+void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct)
+{
+	DMAy_Channelx->CFGR = DMA_InitStruct->DMA_DIR | DMA_InitStruct->DMA_Mode |
+		DMA_InitStruct->DMA_PeripheralInc | DMA_InitStruct->DMA_MemoryInc |
+		DMA_InitStruct->DMA_PeripheralDataSize | DMA_InitStruct->DMA_MemoryDataSize |
+		DMA_InitStruct->DMA_Priority | DMA_InitStruct->DMA_M2M;
+	DMAy_Channelx->CNTR = DMA_InitStruct->DMA_BufferSize;
+	if (DMAy_Channelx == DMA1_Channel5)
+		u32RxReload = DMA_InitStruct->DMA_BufferSize; // circular mode starts over from here
+	DMAy_Channelx->PADDR = DMA_InitStruct->DMA_PeripheralBaseAddr;
+	DMAy_Channelx->MADDR = DMA_InitStruct->DMA_MemoryBaseAddr;
+}
+
+static void simDMAIRQ(void)
+{
+	DMA1->INTFCR = 0;
+	DMA1_Channel3_IRQHandler();
+	DMA1->INTFR &= ~DMA1->INTFCR;
+} /* simDMAIRQ() */
+
+//
+// Move the whole block to SPI1, then raise the transfer complete interrupt
+//
+static void simDMARun(void)
+{
+	DMA_Channel_TypeDef *ch = DMA1_Channel3;
+	uint8_t *s;
+	int iStep;
+	uint16_t u16;
+
+	if (!(ch->CFGR & DMA_CFGR1_EN) || ch->CNTR == 0 || !(SPI1->CTLR2 & SPI_CTLR2_TXDMAEN))
+		return;
+	simStats.u32DMATransfers++;
+	s = (uint8_t *)ch->MADDR;
+	iStep = (ch->CFGR & DMA_CFGR_MSIZE) ? 2 : 1;
+	while (ch->CNTR) {
+		if (iStep == 2)
+			memcpy(&u16, s, 2);
+		else
+			u16 = s[0];
+		SPI_I2S_SendData(SPI1, u16);
+		if (ch->CFGR & DMA_CFGR_MINC)
+			s += iStep;
+		ch->CNTR--;
+	}
+	DMA1->INTFR |= (DMA1_IT_GL3 | DMA1_IT_TC3);
+	if (ch->CFGR & DMA_CFGR_TCIE) {
+		if (bDMAIRQEnabled)
+			simDMAIRQ();
+		else
+			bDMAIRQPending = 1; // taken when NVIC_EnableIRQ() is called
+	}
+} /* simDMARun() */
+
+//
+// Run the ISR and any transfers it starts without recursing
+//
+static void simDMAKick(int bIRQ)
+{
+	if (iDMANest) { // started from the ISR; run it once the ISR returns
+		bDMARestart = 1;
+		return;
+	}
+	iDMANest = 1;
+	bDMARestart = !bIRQ;
+	if (bIRQ)
+		simDMAIRQ();
+	while (bDMARestart) {
+		bDMARestart = 0;
+		simDMARun();
+	}
+	iDMANest = 0;
+} /* simDMAKick() */
+
+void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState)
+{
+	if (NewState == DISABLE) {
+		DMAy_Channelx->CFGR &= ~DMA_CFGR1_EN;
+		return;
+	}
+	DMAy_Channelx->CFGR |= DMA_CFGR1_EN;
+	simDMAKick(0);
+}
+
+void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState)
+{
+	if (NewState != DISABLE)
+		DMAy_Channelx->CFGR |= DMA_IT;
+	else
+		DMAy_Channelx->CFGR &= ~DMA_IT;
+}
+
+ITStatus DMA_GetITStatus(uint32_t DMAy_IT)
+{
+	return (DMA1->INTFR & DMAy_IT) ? SET : RESET;
+}
+
+void DMA_ClearITPendingBit(uint32_t DMAy_IT)
+{
+	DMA1->INTFR &= ~DMAy_IT;
+}
+
+//
+// NVIC
+//
+void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct) { (void)NVIC_InitStruct; }
+void NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	if (IRQn == DMA1_Channel5_IRQn)
+		bRxIRQEnabled = 1;
+	if (IRQn != DMA1_Channel3_IRQn) return;
+	bDMAIRQEnabled = 1;
+	if (bDMAIRQPending) {
+		bDMAIRQPending = 0;
+		simDMAKick(1);
+	}
+}
+void NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	if (IRQn == DMA1_Channel3_IRQn)
+		bDMAIRQEnabled = 0;
+	else if (IRQn == DMA1_Channel5_IRQn)
+		bRxIRQEnabled = 0;
+}
+
+//
+// USART (data only arrives through lcdSimUARTReceive())
+//
+void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct) { (void)USARTx; (void)USART_InitStruct; }
+void USART_DeInit(USART_TypeDef *USARTx) { memset(USARTx, 0, sizeof(USART_TypeDef)); }
+void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState) { (void)USARTx; (void)NewState; }
+void USART_HalfDuplexCmd(USART_TypeDef *USARTx, FunctionalState NewState) { (void)USARTx; (void)NewState; }
+FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG)
+{
+	return (USARTx->STATR & USART_FLAG) ? SET : RESET;
+}
+uint16_t USART_ReceiveData(USART_TypeDef *USARTx)
+{
+	USARTx->STATR &= ~USART_FLAG_RXNE;
+	return USARTx->DATAR;
+}
+void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState)
+{
+	if (NewState != DISABLE)
+		USARTx->CTLR3 |= USART_DMAReq;
+	else
+		USARTx->CTLR3 &= ~USART_DMAReq;
+}
+
+//
+// Bytes arriving on the USART1 RX pin
+// With receive DMA enabled they go to channel 5's buffer (reloading in
+// circular mode), otherwise to DATAR, setting ORE if the last byte
+// hasn't been read yet
+//
+void lcdSimUARTReceive(const uint8_t *pData, int iLen)
+{
+	DMA_Channel_TypeDef *ch = DMA1_Channel5;
+	uint8_t *d;
+
+	while (iLen--) {
+		if ((USART1->CTLR3 & USART_DMAReq_Rx) && (ch->CFGR & DMA_CFGR1_EN) && ch->CNTR) {
+			d = (uint8_t *)ch->MADDR;
+			d[u32RxReload - ch->CNTR] = *pData++;
+			if (--ch->CNTR == 0) {
+				if (ch->CFGR & DMA_Mode_Circular)
+					ch->CNTR = u32RxReload;
+				DMA1->INTFR |= (DMA1_IT_GL5 | DMA1_IT_TC5);
+				if ((ch->CFGR & DMA_IT_TC) && bRxIRQEnabled)
+					DMA1_Channel5_IRQHandler();
+			}
+		} else {
+			if (USART1->STATR & USART_FLAG_RXNE)
+				USART1->STATR |= USART_FLAG_ORE;
+			USART1->DATAR = *pData++;
+			USART1->STATR |= USART_FLAG_RXNE;
+		}
+	}
+} /* lcdSimUARTReceive() */
+
+//
+// I2C
+//
+void I2C_Init(I2C_TypeDef *I2Cx, I2C_InitTypeDef *I2C_InitStruct) { (void)I2Cx; (void)I2C_InitStruct; }
+void I2C_DeInit(I2C_TypeDef *I2Cx) { memset(I2Cx, 0, sizeof(I2C_TypeDef)); }
+void I2C_Cmd(I2C_TypeDef *I2Cx, FunctionalState NewState) { (void)I2Cx; (void)NewState; }
+void I2C_AcknowledgeConfig(I2C_TypeDef *I2Cx, FunctionalState NewState) { (void)I2Cx; (void)NewState; }
+void I2C_GenerateSTART(I2C_TypeDef *I2Cx, FunctionalState NewState) { (void)I2Cx; (void)NewState; }
+void I2C_GenerateSTOP(I2C_TypeDef *I2Cx, FunctionalState NewState) { (void)I2Cx; (void)NewState; }
+void I2C_Send7bitAddress(I2C_TypeDef *I2Cx, uint8_t Address, uint8_t I2C_Direction) { (void)I2Cx; (void)Address; (void)I2C_Direction; }
+void I2C_SendData(I2C_TypeDef *I2Cx, uint8_t Data) { I2Cx->DATAR = Data; }
+uint8_t I2C_ReceiveData(I2C_TypeDef *I2Cx) { return (uint8_t)I2Cx->DATAR; }
+int I2C_CheckEvent(I2C_TypeDef *I2Cx, uint32_t I2C_EVENT) { (void)I2Cx; (void)I2C_EVENT; return 1; }
+FlagStatus I2C_GetFlagStatus(I2C_TypeDef *I2Cx, uint32_t I2C_FLAG)
+{
+	(void)I2Cx;
+	return (I2C_FLAG == I2C_FLAG_BUSY) ? RESET : SET;
+}
+void I2C_ITConfig(I2C_TypeDef *I2Cx, uint16_t I2C_IT, FunctionalState NewState)
+{
+	if (NewState != DISABLE)
+		I2Cx->CTLR2 |= I2C_IT;
+	else
+		I2Cx->CTLR2 &= ~I2C_IT;
+}
+void I2C_SoftwareResetCmd(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	if (NewState != DISABLE)
+		I2Cx->CTLR1 |= I2C_CTLR1_SWRST;
+	else
+		I2Cx->CTLR1 &= ~I2C_CTLR1_SWRST;
+}
+
+//
+// EXTI
+//
+void EXTI_Init(EXTI_InitTypeDef *EXTI_InitStruct) { (void)EXTI_InitStruct; }
@@ -0,0 +1,61 @@
+//
+// lcd_sim.h
+// Host (Linux) simulator for the SPI/DMA/GPIO peripherals used by
+// Arduino.c + spi_lcd.c and a virtual Sitronix/GalaxyCore panel
+//
+// Copyright 2023 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#ifndef HOST_LCD_SIM_H_
+#define HOST_LCD_SIM_H_
+
+#include <stdint.h>
+
+//
+// Counters collected from the SPI traffic seen by the virtual panel
+// All times are simulated (derived from the SPI clock and Delay_xx calls)
+//
+typedef struct lcd_sim_stats_tag {
+	uint32_t u32Bytes;        // total bytes clocked out of SPI1
+	uint32_t u32CmdBytes;     // bytes sent with DC low
+	uint32_t u32DataBytes;    // bytes sent with DC high
+	uint32_t u32Pixels;       // pixels written into GRAM
+	uint32_t u32Transactions; // number of CS low->high frames
+	uint32_t u32DMATransfers; // number of DMA channel 3 transfers
+	uint32_t u32Cmds[256];    // count of each command byte received
+	uint64_t u64SPITimeNs;    // time spent clocking bits at the current SCK rate
+	uint64_t u64DelayNs;      // time spent in Delay_Us()/Delay_Ms()
+	uint32_t u32TimingErrors; // short reset pulses and commands sent too soon after a reset or SLPOUT
+} LCDSIMSTATS;
+
+// Connect the virtual panel; pins use the same 0xPN numbering as digitalWrite()
+void lcdSimInit(int iLCDType, uint8_t u8CSPin, uint8_t u8DCPin);
+// Also follow the reset line and check the reset/sleep out timing
+void lcdSimSetResetPin(uint8_t u8Pin);
+void lcdSimResetStats(void);
+void lcdSimGetStats(LCDSIMSTATS *pStats);
+void lcdSimPrintStats(const char *szLabel);
+// Simulated time since lcdSimInit() in nanoseconds
+uint64_t lcdSimTimeNs(void);
+// Size of the visible area in ORIENTATION_0
+void lcdSimGetSize(int *pWidth, int *pHeight);
+// Start of the controller's CASET/RASET window and its MADCTL value
+void lcdSimGetWindow(int *pCol, int *pRow, uint8_t *pMADCTL);
+// Read a pixel (RGB565) of the visible area as seen in ORIENTATION_0
+// (after vertical scrolling, like the glass would show it)
+uint16_t lcdSimGetPixel(int x, int y);
+// Write the visible area as a binary PPM file; returns 0 for success
+int lcdSimDumpPPM(const char *szFile);
+// Deliver bytes to USART1 as if they had arrived on its RX pin
+void lcdSimUARTReceive(const uint8_t *pData, int iLen);
+
+#endif /* HOST_LCD_SIM_H_ */
@@ -0,0 +1,894 @@
+//
+// sim_checks.c
+// Behavior checks of the driver features against the virtual panel
+// Each check draws through one API and compares what ends up on the
+// glass with a reference drawn by the plain drawing calls (or with
+// known values); the SPI counters verify the traffic claims
+//
+// Host build:
+//   gcc -O2 -Wall -Ihost -I. Arduino.c spi_lcd.c host/lcd_sim.c host/sim_checks.c -o sim_checks
+// usage: sim_checks (the exit code is the number of failed checks)
+//
+// Copyright 2023 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#include "Arduino.h"
+#include "spi_lcd.h"
+#include "lcd_sim.h"
+
+#define CS_PIN 0xa4
+#define DC_PIN 0xa3
+#define RST_PIN 0xa2
+#define BL_PIN 0xa1
+
+static int iWidth, iHeight; // visible area of the panel under test
+static uint16_t u16Ref[320*240];
+static uint16_t u16Tile[40*30];
+static uint8_t u8Pattern[4*16]; // 32x16 1-bpp
+// Proportional GFXfont made from the built-in 8x8 font
+extern const uint8_t ucFont[];
+static uint8_t u8FontBits[96*8];
+static GFXglyph fontGlyphs[96];
+static GFXfont testFont;
+static uint32_t u32GlyphCache[1024];
+static uint8_t u8FB[160*80]; // 8-bpp indexed framebuffer of the 80x160 panel
+static uint16_t u16Palette[256], u16Palette2[256];
+static uint16_t u16FBTile[20*20];
+static uint8_t u8Ring[64]; // UART receive ring
+static uint8_t u8RemoteRing[512];
+static uint8_t u8Stream[16384]; // remote protocol frames to deliver
+static int iStreamLen;
+static uint8_t u8StreamSum;
+static uint16_t u16Small[4*4];
+static uint8_t u8Block[20*10*2]; // big-endian pixels for lcdQueueDATA()
+
+//
+// Connect a fresh virtual panel and initialize the driver for it
+//
+static void checkStart(int iLCDType)
+{
+	lcdSimInit(iLCDType, CS_PIN, DC_PIN);
+	lcdInit(iLCDType, 24000000, CS_PIN, DC_PIN, RST_PIN, BL_PIN);
+	lcdSimGetSize(&iWidth, &iHeight);
+} /* checkStart() */
+
+static void checkSnapshot(uint16_t *pDest)
+{
+	int x, y;
+
+	for (y=0; y<iHeight; y++)
+		for (x=0; x<iWidth; x++)
+			*pDest++ = lcdSimGetPixel(x, y);
+} /* checkSnapshot() */
+
+//
+// Returns the number of pixels which differ from the reference
+//
+static int checkCompare(const uint16_t *pRef)
+{
+	int x, y, iBad = 0;
+
+	for (y=0; y<iHeight; y++)
+		for (x=0; x<iWidth; x++)
+			if (lcdSimGetPixel(x, y) != *pRef++)
+				iBad++;
+	return iBad;
+} /* checkCompare() */
+
+static void checkTestData(void)
+{
+	int i;
+
+	for (i=0; i<40*30; i++)
+		u16Tile[i] = (uint16_t)(((i / 37) % 3 == 0) ? COLOR_RED : i * 13);
+	for (i=0; i<(int)sizeof(u8Pattern); i++)
+		u8Pattern[i] = (uint8_t)(0x5a ^ (i * 29));
+} /* checkTestData() */
+
+//
+// Turn the 8x8 font (columns of 8 bits) into a proportional GFXfont
+// with MSB-first rows of each glyph's used width
+//
+static void checkBuildFont(void)
+{
+	int c, x, y, w, iBit = 0;
+	const uint8_t *s;
+
+	for (c=0; c<96; c++) {
+		s = &ucFont[c*7];
+		for (w=0, x=0; x<7; x++)
+			if (s[x]) w = x+1;
+		if (w == 0) w = 2; // space
+		iBit = (iBit + 7) & ~7;
+		fontGlyphs[c].bitmapOffset = (uint16_t)(iBit >> 3);
+		fontGlyphs[c].width = (uint8_t)w;
+		fontGlyphs[c].height = 8;
+		fontGlyphs[c].xAdvance = (uint8_t)(w + 1);
+		fontGlyphs[c].xOffset = 0;
+		fontGlyphs[c].yOffset = -7;
+		for (y=0; y<8; y++)
+			for (x=0; x<w; x++, iBit++)
+				if (s[x] & (1 << y))
+					u8FontBits[iBit >> 3] |= (0x80 >> (iBit & 7));
+	}
+	testFont.bitmap = u8FontBits;
+	testFont.glyph = fontGlyphs;
+	testFont.first = 32;
+	testFont.last = 127;
+	testFont.yAdvance = 9;
+} /* checkBuildFont() */
+
+//
+// Display list: overlapping items are composed once per band and every
+// pixel of the display is sent exactly once
+//
+static int checkDisplayList(void)
+{
+	LCDDLITEM items[8];
+	LCDDL dl;
+	LCDSIMSTATS stats;
+	int x, y, iBad;
+
+	checkStart(LCD_ST7789_240x280);
+	lcdFill(COLOR_BLUE); // reference: the same scene drawn directly, back to front
+	lcdFillRect(10, 10, 120, 60, COLOR_RED);
+	lcdFillRect(60, 40, 100, 100, COLOR_GREEN);
+	lcdDrawTile(100, 50, 40, 30, (uint8_t *)u16Tile, 80);
+	for (y=0; y<16; y++)
+		for (x=0; x<32; x++)
+			if (u8Pattern[y*4 + (x >> 3)] & (0x80 >> (x & 7)))
+				lcdFillRect(120 + x, 60 + y, 1, 1, COLOR_YELLOW); // transparent pattern
+	lcdWriteString(20, 200, "Display list", COLOR_WHITE, COLOR_BLACK, FONT_8x8);
+	lcdWriteString(130, 70, "12x16", COLOR_CYAN, COLOR_MAGENTA, FONT_12x16);
+	checkSnapshot(u16Ref);
+
+	checkStart(LCD_ST7789_240x280);
+	lcdDLInit(&dl, items, 8, COLOR_BLUE);
+	lcdDLAddRect(&dl, 10, 10, 120, 60, COLOR_RED);
+	lcdDLAddRect(&dl, 60, 40, 100, 100, COLOR_GREEN);
+	lcdDLAddTile(&dl, 100, 50, 40, 30, (uint8_t *)u16Tile, 80);
+	lcdDLAddPattern(&dl, 120, 60, 32, 16, u8Pattern, 4, COLOR_YELLOW);
+	lcdDLAddText(&dl, 20, 200, "Display list", COLOR_WHITE, COLOR_BLACK, FONT_8x8);
+	lcdDLAddText(&dl, 130, 70, "12x16", COLOR_CYAN, COLOR_MAGENTA, FONT_12x16);
+	lcdSimResetStats();
+	lcdDLRender(&dl);
+	lcdWaitDMA();
+	lcdSimGetStats(&stats);
+	iBad = checkCompare(u16Ref);
+	if (stats.u32Pixels != (uint32_t)(iWidth * iHeight)) {
+		printf("  %u pixels sent for a %dx%d display\n", stats.u32Pixels, iWidth, iHeight);
+		iBad++;
+	}
+	return iBad;
+} /* checkDisplayList() */
+
+//
+// Dirty rectangles: after a change only the invalidated areas are sent
+// and the glass matches a complete redraw of the display list
+//
+static int checkDirtyFlush(void)
+{
+	LCDDLITEM items[4];
+	LCDDL dl;
+	LCDFLUSHSTATS fs;
+	LCDSIMSTATS stats;
+	char szValue[8] = "412";
+	int i, iBad = 0;
+
+	checkStart(LCD_ST7735_80x160);
+	lcdDLInit(&dl, items, 4, COLOR_BLACK);
+	lcdDLAddText(&dl, 4, 10, "CO2 ppm", COLOR_WHITE, COLOR_BLACK, FONT_8x8);
+	lcdDLAddText(&dl, 4, 30, szValue, COLOR_GREEN, COLOR_BLACK, FONT_12x16);
+	lcdDLAddRect(&dl, 100, 50, 40, 20, COLOR_RED);
+	lcdInvalidateAll();
+	lcdFlush(&dl);
+	szValue[2] = '9'; // one digit changes
+	lcdInvalidate(4 + 24, 30, 12, 16);
+	lcdInvalidate(150, 70, 5, 5); // far away; must not be merged with it
+	if (lcdDirtyCount() != 2)
+		iBad++;
+	lcdSimResetStats();
+	lcdFlush(&dl);
+	lcdWaitDMA();
+	lcdSimGetStats(&stats);
+	lcdGetFlushStats(&fs);
+	if (lcdDirtyCount() != 0 || fs.u32Rects != 2 || fs.u32Pixels != 12*16 + 5*5 ||
+	    stats.u32Pixels != fs.u32Pixels || fs.u32Bytes >= fs.u32BoundBytes || fs.u32BoundBytes >= fs.u32FullBytes) {
+		printf("  rects %u pixels %u (sent %u) bytes %u bound %u full %u\n", fs.u32Rects, fs.u32Pixels,
+		       stats.u32Pixels, fs.u32Bytes, fs.u32BoundBytes, fs.u32FullBytes);
+		iBad++;
+	}
+	for (i=0; i<20; i++) // more areas than slots; they get merged, nothing is lost
+		lcdInvalidate(i*7, i*4, 3, 3);
+	if (lcdDirtyCount() > LCD_MAX_DIRTY)
+		iBad++;
+	lcdFlush(&dl);
+	lcdWaitDMA();
+	checkSnapshot(u16Ref);
+
+	checkStart(LCD_ST7735_80x160);
+	lcdDLRender(&dl);
+	lcdWaitDMA();
+	return iBad + checkCompare(u16Ref);
+} /* checkDirtyFlush() */
+
+static void checkGlyphScene(void)
+{
+	lcdFill(COLOR_BLUE);
+	lcdWriteStringCustom(&testFont, 2, 10, "CO2: 412 ppm", COLOR_YELLOW, COLOR_RED, 1);
+	lcdWriteStringCustom(&testFont, 2, 20, "Hello Wgjy", COLOR_WHITE, COLOR_WHITE, 0); // transparent
+	lcdWriteStringCustom(&testFont, 150, 75, "clip", COLOR_WHITE, COLOR_BLACK, 1);
+} /* checkGlyphScene() */
+
+//
+// Glyph cache: the same pixels with and without it, repeated glyphs
+// are hits and a small budget evicts without changing the output
+//
+static int checkGlyphCache(void)
+{
+	LCDGLYPHCACHESTATS gs;
+	uint32_t u32Misses;
+	int iBad = 0;
+
+	checkStart(LCD_ST7735_80x160);
+	checkGlyphScene();
+	checkSnapshot(u16Ref);
+
+	checkStart(LCD_ST7735_80x160);
+	lcdGlyphCacheInit((uint8_t *)u32GlyphCache, sizeof(u32GlyphCache));
+	checkGlyphScene();
+	lcdGetGlyphCacheStats(&gs);
+	u32Misses = gs.u32Misses;
+	checkGlyphScene(); // everything is cached now
+	lcdGetGlyphCacheStats(&gs);
+	if (gs.u32Misses != u32Misses || gs.u32Hits < 12 || gs.u32Evictions != 0) {
+		printf("  hits %u misses %u (first pass %u) evictions %u\n", gs.u32Hits, gs.u32Misses, u32Misses, gs.u32Evictions);
+		iBad++;
+	}
+	lcdWaitDMA();
+	iBad += checkCompare(u16Ref);
+
+	checkStart(LCD_ST7735_80x160);
+	lcdGlyphCacheInit((uint8_t *)u32GlyphCache, 256); // room for very few glyphs
+	checkGlyphScene();
+	lcdWaitDMA();
+	lcdGetGlyphCacheStats(&gs);
+	if (gs.u32Evictions == 0 || gs.iBytesUsed > 256)
+		iBad++;
+	iBad += checkCompare(u16Ref);
+	lcdGlyphCacheInit(NULL, 0);
+	return iBad;
+} /* checkGlyphCache() */
+
+//
+// Batched proportional text: one window per string, the glyphs placed
+// exactly where lcdWriteStringCustom() puts them, also in a display list
+//
+static int checkCustomText(void)
+{
+	LCDDLITEM items[4];
+	LCDDL dl;
+	int iBad;
+
+	checkStart(LCD_ST7789_240x280);
+	lcdFill(COLOR_BLACK);
+	lcdFillRect(30, 60, 100, 40, COLOR_BLUE);
+	lcdWriteStringCustom(&testFont, 10, 20, "Batch: Wgjy 123", COLOR_WHITE, COLOR_BLACK, 0);
+	lcdWriteStringCustom(&testFont, 40, 80, "over a rect", COLOR_YELLOW, COLOR_YELLOW, 0); // transparent
+	checkSnapshot(u16Ref);
+
+	checkStart(LCD_ST7789_240x280);
+	lcdFill(COLOR_BLACK);
+	lcdFillRect(30, 60, 100, 40, COLOR_BLUE);
+	lcdWriteStringCustomBatch(&testFont, 10, 20, "Batch: Wgjy 123", COLOR_WHITE, COLOR_BLACK, NULL, NULL);
+	lcdWriteStringCustom(&testFont, 40, 80, "over a rect", COLOR_YELLOW, COLOR_YELLOW, 0); // transparent
+	lcdWaitDMA();
+	iBad = checkCompare(u16Ref); // the box it erases is black already
+	lcdDLInit(&dl, items, 4, COLOR_BLACK);
+	lcdDLAddRect(&dl, 30, 60, 100, 40, COLOR_BLUE);
+	lcdDLAddTextCustom(&dl, &testFont, 10, 20, "Batch: Wgjy 123", COLOR_WHITE);
+	lcdDLAddTextCustom(&dl, &testFont, 40, 80, "over a rect", COLOR_YELLOW);
+	lcdDLRender(&dl);
+	lcdWaitDMA();
+	return iBad + checkCompare(u16Ref);
+} /* checkCustomText() */
+
+//
+// Write 37 numbered lines to the console and compare what's on the glass
+// with the lines it should still show, drawn directly
+//
+static int checkConsoleRun(int iLCDType, int iOrient, int bExpectHW)
+{
+	LCDSIMSTATS stats;
+	char szLine[16];
+	int i, iRow, iRows, iBad, bHW;
+	const int iLines = 37;
+
+	checkStart(iLCDType);
+	lcdOrientation(iOrient);
+	bHW = lcdConsoleInit(FONT_8x8, COLOR_WHITE, COLOR_BLUE);
+	iBad = (bHW != bExpectHW);
+	for (i=0; i<iLines; i++) {
+		if (i == iLines-1)
+			lcdSimResetStats();
+		sprintf(szLine, "Ln%d\n", i);
+		lcdConsoleWrite(szLine);
+	}
+	lcdSimGetStats(&stats);
+	checkSnapshot(u16Ref);
+	iRows = ((iOrient & 1) ? iWidth : iHeight) / 8;
+	if (bHW && stats.u32Bytes > (uint32_t)(iWidth + iHeight) * 8 * 2 + 64)
+		iBad++; // a new line should only cost erasing and drawing one row
+
+	checkStart(iLCDType);
+	lcdOrientation(iOrient);
+	lcdFill(COLOR_BLUE);
+	for (i=0; i<iLines; i++) {
+		if (bHW) { // scrolled; the cursor sits on the empty bottom row
+			if (iLines - 1 - i >= iRows - 1) continue;
+			iRow = iRows - 2 - (iLines - 1 - i);
+		} else { // wrapped; the cursor row was erased
+			iRow = i % iRows;
+			if (i < iLines - iRows || iRow == iLines % iRows) continue;
+		}
+		sprintf(szLine, "Ln%d", i);
+		lcdWriteString(0, iRow * 8, szLine, COLOR_WHITE, COLOR_BLUE, FONT_8x8);
+	}
+	return iBad + checkCompare(u16Ref);
+} /* checkConsoleRun() */
+
+//
+// Console: the portrait orientations scroll in hardware, also with the
+// row order flipped; landscape (MV set) falls back to wrapping
+//
+static int checkConsole(void)
+{
+	return checkConsoleRun(LCD_ST7789_240x280, ORIENTATION_90, 1) +
+		checkConsoleRun(LCD_ST7789_240x280, ORIENTATION_270, 1) +
+		checkConsoleRun(LCD_ST7735_80x160, ORIENTATION_90, 1) +
+		checkConsoleRun(LCD_ST7789_240x280, ORIENTATION_0, 0);
+} /* checkConsole() */
+
+//
+// Draw the same scene with palette indices (pPalette == NULL) or with
+// the RGB565 colors they stand for
+//
+static void checkFBScene(const uint16_t *pPalette, int iColors)
+{
+	int i;
+
+#define FB_COLOR(i) (uint16_t)((pPalette == NULL) ? (i) : pPalette[i])
+	for (i=0; i<20*20; i++) // tiles are always RGB565
+		u16FBTile[i] = (pPalette == NULL) ? u16Palette[(i / 20) % iColors] : pPalette[(i / 20) % iColors];
+	lcdFillRect(0, 0, iWidth, iHeight, FB_COLOR(1));
+	lcdFillRect(10, 5, 37, 20, FB_COLOR(2));
+	lcdWriteString(3, 30, "Indexed FB!", FB_COLOR(3), FB_COLOR(0), FONT_8x8);
+	lcdWriteString(-2, 50, "12x16", FB_COLOR(iColors - 1), FB_COLOR(1), FONT_12x16);
+	lcdDrawTile(120, 40, 20, 20, (uint8_t *)u16FBTile, 40);
+#undef FB_COLOR
+} /* checkFBScene() */
+
+//
+// Indexed framebuffer at 2 and 8 bpp: the flushed scene matches direct
+// drawing, only changed rows are resent, a new palette recolors every
+// row and editing the palette in place resets the nearest-color match
+//
+static int checkFramebuffer(void)
+{
+	uint16_t u16Map[256];
+	LCDSIMSTATS stats;
+	int i, iBpp, iColors, iBad = 0;
+
+	for (i=0; i<256; i++) {
+		u16Palette[i] = (uint16_t)((i * 0x1111) + (i * 7));
+		u16Palette2[i] = (uint16_t)~u16Palette[i];
+	}
+	u16Palette[0] = COLOR_BLACK;
+	u16Palette[1] = COLOR_BLUE;
+	for (iBpp=2; iBpp<=8; iBpp+=6) {
+		iColors = 1 << iBpp;
+		checkStart(LCD_ST7735_80x160);
+		checkFBScene(u16Palette, iColors);
+		checkSnapshot(u16Ref);
+		checkStart(LCD_ST7735_80x160);
+		if (lcdFBInit(u8FB, iBpp, u16Palette) != 0)
+			return 1;
+		lcdSimResetStats();
+		checkFBScene(NULL, iColors);
+		lcdSimGetStats(&stats);
+		iBad += (stats.u32Bytes != 0); // nothing goes out before the flush
+		iBad += (lcdFBFlush() != iHeight);
+		iBad += checkCompare(u16Ref);
+		lcdWriteString(3, 30, "I", 3, 0, FONT_8x8); // same pixels, 8 dirty rows
+		iBad += (lcdFBFlush() != 8);
+		iBad += (lcdFBFlush() != 0);
+		iBad += checkCompare(u16Ref);
+		// a new palette recolors everything without redrawing
+		lcdFBSetPalette(u16Palette2);
+		iBad += (lcdFBFlush() != iHeight);
+		checkSnapshot(u16Ref);
+		lcdFBInit(NULL, 0, NULL);
+		for (i=0; i<iColors; i++)
+			u16Map[i] = u16Palette2[i];
+		checkStart(LCD_ST7735_80x160);
+		checkFBScene(u16Map, iColors);
+		iBad += checkCompare(u16Ref);
+	}
+	// same palette pointer, different contents
+	checkStart(LCD_ST7735_80x160);
+	lcdFBInit(u8FB, 8, u16Palette);
+	for (i=0; i<20*20; i++)
+		u16FBTile[i] = 0x1234;
+	lcdDrawTile(0, 0, 20, 20, (uint8_t *)u16FBTile, 40);
+	iBad += (u8FB[0] == 200); // not an exact match yet
+	u16Palette[200] = 0x1234;
+	lcdFBSetPalette(u16Palette);
+	lcdDrawTile(0, 0, 20, 20, (uint8_t *)u16FBTile, 40);
+	iBad += (u8FB[0] != 200);
+	lcdFBFlush();
+	iBad += (lcdSimGetPixel(0, 0) != 0x1234);
+	lcdFBInit(NULL, 0, NULL);
+	return iBad;
+} /* checkFramebuffer() */
+
+static int iRefreshFills, iRefreshDone;
+
+static void checkRefreshFill(int x, int y, int w, int h, uint16_t *pPixels, void *pUser)
+{
+	int tx, ty;
+
+	(void)pUser;
+	iRefreshFills++;
+	for (ty=y; ty<y+h; ty++)
+		for (tx=x; tx<x+w; tx++)
+			*pPixels++ = (uint16_t)((tx * 7) + (ty * 131));
+} /* checkRefreshFill() */
+
+//
+// Frame-done callback; starts the next frame while the count lasts
+//
+static void checkRefreshDone(void *pUser)
+{
+	int *pFrames = (int *)pUser;
+
+	iRefreshDone++;
+	if (*pFrames > 0) {
+		(*pFrames)--;
+		lcdRefreshStart(0, 0, 500, 500, checkRefreshFill, NULL, checkRefreshDone, pUser);
+	}
+} /* checkRefreshDone() */
+
+//
+// Background refresh: three chained frames of a clipped area run from
+// the DMA interrupt alone, every pixel gets its band's value and normal
+// drawing works again afterwards
+//
+static int checkRefresh(void)
+{
+	static const int iTypes[] = {LCD_ST7735_80x160, LCD_ST7789_240x280};
+	int i, x, y, iFrames, iBad = 0;
+
+	for (i=0; i<2; i++) {
+		checkStart(iTypes[i]);
+		iRefreshFills = iRefreshDone = 0;
+		iFrames = 2;
+		iBad += (lcdRefreshStart(-3, 0, 500, 500, checkRefreshFill, NULL, checkRefreshDone, &iFrames) != 0);
+		while (lcdRefreshBusy()) {};
+		iBad += (iRefreshDone != 3) + (lcdRefreshFrames() != 3);
+		iBad += (iRefreshFills < 3 * ((iHeight + CACHED_LINES - 1) / CACHED_LINES)); // one per band
+		for (y=0; y<iHeight; y++)
+			for (x=0; x<iWidth; x++)
+				if (lcdSimGetPixel(x, y) != (uint16_t)((x * 7) + (y * 131)))
+					iBad++;
+		lcdFillRect(0, 0, 4, 4, COLOR_WHITE);
+		iBad += (lcdSimGetPixel(1, 1) != COLOR_WHITE);
+		iBad += (lcdRefreshStart(iWidth, 0, 8, 8, checkRefreshFill, NULL, NULL, NULL) != -1);
+	}
+	return iBad;
+} /* checkRefresh() */
+
+//
+// Core timer: lcdInit() and the I2C code time things with SysTick but
+// must leave it the way Delay_Us()/Delay_Ms() expect (HCLK/8), so later
+// delays last as long as asked
+//
+static int checkTimeBase(void)
+{
+	LCDSIMSTATS stats;
+	int iBad;
+
+	checkStart(LCD_ST7789_240x280);
+	lcdFill(COLOR_BLACK);
+	Delay_Us(10); // leaves SysTick stopped, as an application would
+	I2CInit(0xb7, 0xb6, 400000);
+	I2CTest(0x3c); // nothing answers
+	iBad = ((SysTick->CTLR & 4) != 0); // STCLK must still select HCLK/8
+	lcdSimResetStats();
+	Delay_Us(1000);
+	Delay_Ms(2);
+	lcdSimGetStats(&stats);
+	iBad += (stats.u64DelayNs != 3000000);
+	return iBad;
+} /* checkTimeBase() */
+
+//
+// Boot timing: with the SDK's Delay_Us() (whole SysTick ticks per
+// microsecond, so slightly short at clocks which aren't a multiple of
+// 8 MHz) every init mode keeps the datasheet reset and sleep out times,
+// and the boot clock agrees with the simulated time
+//
+static int checkBootTiming(void)
+{
+	static const uint32_t u32Clocks[] = {144000000, 100000000, 36000000};
+	static const int iTypes[] = {LCD_ST7789_240x280, LCD_GC9107_128x128};
+	static const int iModes[] = {0, LCD_INIT_FAST, LCD_INIT_FAST | LCD_INIT_NO_HWRESET, LCD_INIT_FAST | LCD_INIT_CLEAR};
+	LCDSIMSTATS stats;
+	LCDBOOTSTATS boot;
+	uint32_t u32SimUs;
+	int c, t, m, iBad = 0;
+
+	for (c=0; c<3; c++) {
+		SystemCoreClock = u32Clocks[c];
+		for (t=0; t<2; t++) {
+			for (m=0; m<4; m++) {
+				lcdSimInit(iTypes[t], CS_PIN, DC_PIN);
+				lcdSimSetResetPin(RST_PIN);
+				lcdInitEx(iTypes[t], 0, CS_PIN, DC_PIN, RST_PIN, BL_PIN, iModes[m], NULL, NULL);
+				lcdSimGetStats(&stats);
+				lcdGetBootStats(&boot);
+				u32SimUs = (uint32_t)(lcdSimTimeNs() / 1000);
+				// the original sequence gives the GC9107 100ms after SLPOUT,
+				// less than the 120ms the fast path allows it
+				if (iModes[m] != 0 || iTypes[t] != LCD_GC9107_128x128)
+					iBad += stats.u32TimingErrors;
+				if (boot.u32InitUs > u32SimUs + 10 || boot.u32InitUs + 10 + u32SimUs / 100 < u32SimUs)
+					iBad++; // the boot clock lost or invented time
+				if (iModes[m] == 0) continue;
+				// still in sleep mode; the boot should end soon after SLPOUT is allowed
+				if (u32SimUs > 125000 + ((iTypes[t] == LCD_GC9107_128x128) ? 120000 : 5000) + 20000)
+					iBad++;
+			}
+		}
+	}
+	SystemCoreClock = 144000000;
+	return iBad;
+} /* checkBootTiming() */
+
+//
+// MADCTL value and window offsets of every panel and orientation as the
+// per-panel switch in lcdInit() produced them (the 80x160_B, 240x240 and
+// 240x320, which had no case there, follow the same rule)
+//
+static const struct {
+	uint8_t u8MADCTL;
+	int iXOff, iYOff;
+} orientTable[LCD_COUNT][4] = {
+	{{0x68, 0, 24}, {0x08, 24, 0}, {0xa8, 0, 24}, {0xc8, 24, 0}}, // LCD_ST7735_80x160
+	{{0x68, 1, 26}, {0x08, 26, 1}, {0xa8, 1, 26}, {0xc8, 26, 1}}, // LCD_ST7735_80x160_B
+	{{0x68, 1, 0}, {0x08, 0, 1}, {0xa8, 1, 0}, {0xc8, 0, 1}}, // LCD_ST7735_128x128
+	{{0x60, 0, 0}, {0x00, 0, 0}, {0xa0, 0, 0}, {0xc0, 0, 0}}, // LCD_ST7735_128x160
+	{{0x60, 40, 53}, {0x00, 53, 40}, {0xa0, 40, 53}, {0xc0, 53, 40}}, // LCD_ST7789_135x240
+	{{0x60, 0, 34}, {0x00, 34, 0}, {0xa0, 0, 34}, {0xc0, 34, 0}}, // LCD_ST7789_172x320
+	{{0x60, 0, 0}, {0x00, 0, 0}, {0xa0, 0, 0}, {0xc0, 0, 0}}, // LCD_ST7789_240x240
+	{{0x60, 20, 0}, {0x00, 0, 20}, {0xa0, 20, 0}, {0xc0, 0, 20}}, // LCD_ST7789_240x280
+	{{0x60, 0, 0}, {0x00, 0, 0}, {0xa0, 0, 0}, {0xc0, 0, 0}}, // LCD_ST7789_240x320
+	{{0x68, 1, 2}, {0x08, 2, 1}, {0xa8, 1, 2}, {0xc8, 2, 1}}, // LCD_GC9107_128x128
+};
+
+//
+// Panel table: lcdOrientation() sends the same MADCTL and window as the
+// old code for every panel and orientation
+//
+static int checkOrientation(void)
+{
+	int t, o, iCol, iRow, iBad = 0;
+	uint8_t u8MADCTL;
+
+	for (t=0; t<LCD_COUNT; t++) {
+		for (o=0; o<4; o++) {
+			checkStart(t);
+			lcdOrientation(o);
+			lcdFillRect(0, 0, 1, 1, COLOR_RED);
+			lcdSimGetWindow(&iCol, &iRow, &u8MADCTL);
+			if (u8MADCTL != orientTable[t][o].u8MADCTL || iCol != orientTable[t][o].iXOff || iRow != orientTable[t][o].iYOff) {
+				printf("  type %d orientation %d: MADCTL 0x%02x at %d,%d\n", t, o, u8MADCTL, iCol, iRow);
+				iBad++;
+			}
+		}
+	}
+	return iBad;
+} /* checkOrientation() */
+
+//
+// UART ring buffer: lines split across arrivals, many trips around the
+// ring, an overrun which keeps the newest bytes and counts the lost ones,
+// and a line longer than the caller's buffer returned in pieces
+//
+static int checkUARTRing(void)
+{
+	uint8_t u8Data[200], u8Out[64];
+	char szLine[32];
+	UARTSTATS stats;
+	int i, iBad = 0;
+
+	for (i=0; i<(int)sizeof(u8Data); i++)
+		u8Data[i] = (uint8_t)i;
+	UART_Init(115200);
+	iBad += (UART_BeginRx(u8Ring, sizeof(u8Ring)) != 0);
+	iBad += (UART_Available() != 0) + (UART_ReadByte() != -1) + (UART_Peek() != -1);
+	lcdSimUARTReceive((const uint8_t *)"hello\r\nwor", 10);
+	iBad += (UART_Available() != 10) + (UART_Peek() != 'h');
+	iBad += (UART_ReadLine(szLine, sizeof(szLine)) != 5) + (strcmp(szLine, "hello") != 0);
+	iBad += (UART_ReadLine(szLine, sizeof(szLine)) != -1); // "wor" isn't a line yet
+	lcdSimUARTReceive((const uint8_t *)"ld\n", 3);
+	iBad += (UART_ReadLine(szLine, sizeof(szLine)) != 5) + (strcmp(szLine, "world") != 0);
+	for (i=0; i<10; i++) { // 500 bytes through a 64 byte ring
+		lcdSimUARTReceive(&u8Data[i*7], 50);
+		iBad += (UART_ReadBytes(u8Out, sizeof(u8Out)) != 50);
+		iBad += (memcmp(u8Out, &u8Data[i*7], 50) != 0);
+	}
+	lcdSimUARTReceive(u8Data, 150); // nobody reads; the oldest 86 are lost
+	iBad += (UART_Available() != 64);
+	iBad += (UART_ReadBytes(u8Out, sizeof(u8Out)) != 64) + (memcmp(u8Out, &u8Data[86], 64) != 0);
+	UART_GetStats(&stats);
+	iBad += (stats.u32BytesLost != 86) + (stats.u32Overruns == 0);
+	lcdSimUARTReceive((const uint8_t *)"A", 1);
+	iBad += (UART_Read() != 'A') + (UART_Read() != -1);
+	lcdSimUARTReceive((const uint8_t *)"0123456789abcdef\n", 17);
+	iBad += (UART_ReadLine(szLine, 8) != 7) + (strcmp(szLine, "0123456") != 0);
+	iBad += (UART_ReadLine(szLine, 8) != 7) + (strcmp(szLine, "789abcd") != 0);
+	iBad += (UART_ReadLine(szLine, 8) != 2) + (strcmp(szLine, "ef") != 0);
+	UART_DeInit();
+	return iBad;
+} /* checkUARTRing() */
+
+static void checkPut8(int i)
+{
+	u8Stream[iStreamLen++] = (uint8_t)i;
+	u8StreamSum += (uint8_t)i;
+} /* checkPut8() */
+
+static void checkPut16(int i)
+{
+	checkPut8(i & 0xff);
+	checkPut8((i >> 8) & 0xff);
+} /* checkPut16() */
+
+static void checkFrameStart(int iCmd, int iParamLen)
+{
+	u8Stream[iStreamLen++] = LCD_REMOTE_SYNC;
+	u8StreamSum = 0;
+	checkPut8(iCmd);
+	checkPut8(iParamLen);
+} /* checkFrameStart() */
+
+static void checkFrameEnd(int bBad)
+{
+	u8Stream[iStreamLen++] = (uint8_t)(u8StreamSum + bBad);
+} /* checkFrameEnd() */
+
+static void checkFrameRect(int x, int y, int w, int h)
+{
+	checkPut16(x); checkPut16(y); checkPut16(w); checkPut16(h);
+} /* checkFrameRect() */
+
+//
+// RLE-pack the 40x30 test tile into the stream
+//
+static void checkPutRLE(void)
+{
+	int i, j, k;
+
+	for (i=0; i<40*30; ) {
+		for (j=i; j<40*30 && j-i < 128 && u16Tile[j] == u16Tile[i]; j++) {};
+		if (j - i >= 2) { // run
+			checkPut8(0x80 | (j - i - 1));
+			checkPut16(u16Tile[i]);
+		} else { // literals up to the next run
+			for (j=i; j<40*30 && j-i < 128 && !(j+1 < 40*30 && u16Tile[j+1] == u16Tile[j]); j++) {};
+			if (j == i) j = i + 1;
+			checkPut8(j - i - 1);
+			for (k=i; k<j; k++)
+				checkPut16(u16Tile[k]);
+		}
+		i = j;
+	}
+} /* checkPutRLE() */
+
+//
+// Remote protocol: a stream with noise, a bad checksum, an unknown
+// command, a wrong parameter length, pixel counts larger than the window
+// and a clipped tile, delivered in random pieces, draws exactly what the
+// direct calls draw
+//
+static int checkRemote(void)
+{
+	LCDREMOTESTATS stats;
+	int i, iPos, iLen, iBad;
+
+	checkStart(LCD_ST7789_240x280);
+	lcdFillRect(0, 0, iWidth, iHeight, 0x1234);
+	lcdFillRect(10, 10, 50, 20, COLOR_RED);
+	lcdDrawTile(100, 50, 40, 30, (uint8_t *)u16Tile, 80);
+	lcdDrawTile(150, 100, 40, 30, (uint8_t *)u16Tile, 80);
+	lcdWriteString(5, 200, "Remote!", COLOR_WHITE, COLOR_BLUE, FONT_8x8);
+	lcdSetPosition(200, 10, 40, 30);
+	lcdWritePixels(u16Tile, 40*30);
+	checkSnapshot(u16Ref);
+
+	iStreamLen = 0;
+	checkPut8(0x11); checkPut8(0x22); // noise before the first frame
+	checkFrameStart(LCD_REMOTE_FILL, 10);
+	checkFrameRect(0, 0, iWidth, iHeight); checkPut16(0x1234);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_FILL, 10);
+	checkFrameRect(10, 10, 50, 20); checkPut16(COLOR_RED);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_FILL, 10); // bad checksum; not drawn
+	checkFrameRect(0, 0, 20, 20); checkPut16(COLOR_WHITE);
+	checkFrameEnd(1);
+	checkFrameStart(LCD_REMOTE_COUNT + 3, 0); // unknown command
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_FILL, 6); // wrong parameter length
+	checkPut16(1); checkPut16(1); checkPut16(1);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_TILE, 8);
+	checkFrameRect(100, 50, 40, 30);
+	for (i=0; i<40*30; i++)
+		checkPut16(u16Tile[i]);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_TILE_RLE, 8);
+	checkFrameRect(150, 100, 40, 30);
+	checkPutRLE();
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_TEXT, 9 + 7);
+	checkPut16(5); checkPut16(200); checkPut8(FONT_8x8); checkPut16(COLOR_WHITE); checkPut16(COLOR_BLUE);
+	for (i=0; i<7; i++)
+		checkPut8("Remote!"[i]);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_WINDOW, 8);
+	checkFrameRect(200, 10, 40, 30);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_PIXELS, 4);
+	checkPut16(40*30); checkPut16(0);
+	for (i=0; i<40*30; i++)
+		checkPut16(u16Tile[i]);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_PIXELS, 4); // more than the window holds
+	checkPut16(40*30 + 1); checkPut16(0);
+	for (i=0; i<4; i++)
+		checkPut16(0x1111);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_PIXELS, 4); // 2 * count would wrap to 0
+	checkPut16(0); checkPut16(0x8000);
+	for (i=0; i<4; i++)
+		checkPut16(0x2222);
+	checkFrameEnd(0);
+	checkFrameStart(LCD_REMOTE_TILE, 8); // off the right edge; skipped
+	checkFrameRect(iWidth - 10, 0, 20, 2);
+	for (i=0; i<40; i++)
+		checkPut16(COLOR_WHITE);
+	checkFrameEnd(0);
+
+	checkStart(LCD_ST7789_240x280);
+	UART_Init(2000000);
+	UART_BeginRx(u8RemoteRing, sizeof(u8RemoteRing));
+	lcdRemoteResetStats();
+	srand(1);
+	for (iPos=0; iPos<iStreamLen; iPos += iLen) {
+		iLen = 1 + (rand() % 300);
+		if (iLen > iStreamLen - iPos)
+			iLen = iStreamLen - iPos;
+		lcdSimUARTReceive(&u8Stream[iPos], iLen);
+		lcdRemoteProcess();
+	}
+	lcdWaitDMA();
+	iBad = checkCompare(u16Ref);
+	lcdRemoteGetStats(&stats);
+	iBad += (stats.u32Bytes != (uint32_t)iStreamLen) + (stats.u32Frames != 8) + (stats.u32Dropped != 5);
+	iBad += (stats.u32BadChecksum != 1) + (stats.u32BadCommand != 2) + (stats.u32BadCount != 2);
+	iBad += (stats.u32Clipped != 1) + (stats.u32SyncSkipped < 2 + 7 + 2*9);
+	iBad += (stats.u32UARTLost != 0) + lcdRemoteBusy();
+	UART_DeInit();
+	return iBad;
+} /* checkRemote() */
+
+//
+// Descriptor queue: more tiles than there are slots, short (polled) and
+// long (DMA) blocks, raw commands whose parameters live on the stack and
+// a synchronous draw afterwards all match direct drawing
+//
+static int checkQueue(void)
+{
+	uint8_t ucParams[4];
+	int i, x, y, iBad;
+
+	checkStart(LCD_ST7789_240x320);
+	lcdFillRect(0, 0, iWidth, iHeight, COLOR_BLACK);
+	for (i=0; i<32; i++) {
+		x = (i & 7) * 40; y = (i >> 3) * 30;
+		if (i & 1)
+			lcdDrawTile(x, y, 40, 30, (uint8_t *)u16Tile, 80);
+		else
+			lcdFillRect(x + 8, y + 8, 4, 4, COLOR_GREEN);
+	}
+	lcdFillRect(0, 150, 20, 10, COLOR_YELLOW);
+	lcdFillRect(300, 200, 10, 10, COLOR_RED);
+	checkSnapshot(u16Ref);
+
+	for (i=0; i<16; i++)
+		u16Small[i] = COLOR_GREEN;
+	for (i=0; i<20*10; i++) {
+		u8Block[i*2] = COLOR_YELLOW >> 8;
+		u8Block[i*2+1] = COLOR_YELLOW & 0xff;
+	}
+	checkStart(LCD_ST7789_240x320);
+	lcdFillRect(0, 0, iWidth, iHeight, COLOR_BLACK);
+	for (i=0; i<32; i++) {
+		x = (i & 7) * 40; y = (i >> 3) * 30;
+		if (i & 1)
+			lcdQueueTile(x, y, 40, 30, u16Tile);
+		else
+			lcdQueueTile(x + 8, y + 8, 4, 4, u16Small);
+	}
+	ucParams[0] = 0; ucParams[1] = 0; ucParams[2] = 0; ucParams[3] = 19;
+	lcdQueueCMD(0x2a, ucParams, 4); // CASET
+	ucParams[0] = 0; ucParams[1] = 150; ucParams[2] = 0; ucParams[3] = 159;
+	lcdQueueCMD(0x2b, ucParams, 4); // RASET; the CASET copy must be intact
+	lcdQueueCMD(0x2c, NULL, 0); // RAMWR
+	lcdQueueDATA(u8Block, sizeof(u8Block));
+	lcdFillRect(300, 200, 10, 10, COLOR_RED); // waits for the queue
+	lcdWaitDMA();
+	iBad = checkCompare(u16Ref) + lcdDMABusy();
+	return iBad;
+} /* checkQueue() */
+
+typedef struct check_tag {
+	const char *szName;
+	int (*pfnCheck)(void); // returns the number of errors
+} CHECK;
+
+static const CHECK checks[] = {
+	{"display list", checkDisplayList},
+	{"dirty rect flush", checkDirtyFlush},
+	{"glyph cache", checkGlyphCache},
+	{"custom text", checkCustomText},
+	{"console scroll", checkConsole},
+	{"indexed framebuffer", checkFramebuffer},
+	{"background refresh", checkRefresh},
+	{"core timer", checkTimeBase},
+	{"boot timing", checkBootTiming},
+	{"orientation table", checkOrientation},
+	{"UART ring buffer", checkUARTRing},
+	{"remote protocol", checkRemote},
+	{"descriptor queue", checkQueue},
+};
+
+int main(int argc, char *argv[])
+{
+	int i, iErrors, iFailed = 0;
+
+	(void)argc; (void)argv;
+	checkTestData();
+	checkBuildFont();
+	for (i=0; i<(int)(sizeof(checks) / sizeof(checks[0])); i++) {
+		iErrors = (*checks[i].pfnCheck)();
+		printf("%-24s %s", checks[i].szName, iErrors ? "FAIL" : "ok");
+		if (iErrors)
+			printf(" (%d errors)", iErrors);
+		printf("\n");
+		if (iErrors)
+			iFailed++;
+	}
+	printf("%d of %d checks failed\n", iFailed, i);
+	return iFailed;
+} /* main() */
@@ -0,0 +1,71 @@
+//
+// sim_main.c
+// Runs the LCD driver against the virtual panel, prints the SPI traffic
+// of each drawing call and saves the final frame as a PPM image
+//
+// usage: lcd_sim [lcd type] [output.ppm]
+//
+// Copyright 2023 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#include "Arduino.h"
+#include "spi_lcd.h"
+#include "lcd_sim.h"
+
+#define CS_PIN 0xa4
+#define DC_PIN 0xa3
+#define RST_PIN 0xa2
+#define BL_PIN 0xa1
+
+static uint16_t u16Tile[32*32];
+
+int main(int argc, char *argv[])
+{
+	int i, iLCDType = LCD_ST7735_80x160;
+	const char *szOut = "lcd_sim.ppm";
+
+	if (argc > 1) iLCDType = atoi(argv[1]);
+	if (argc > 2) szOut = argv[2];
+	if (iLCDType < 0 || iLCDType >= LCD_COUNT) {
+		printf("Invalid LCD type %d (0-%d)\n", iLCDType, LCD_COUNT-1);
+		return -1;
+	}
+	lcdSimInit(iLCDType, CS_PIN, DC_PIN);
+	lcdInit(iLCDType, 24000000, CS_PIN, DC_PIN, RST_PIN, BL_PIN);
+	lcdSimPrintStats("lcdInit");
+
+	lcdSimResetStats();
+	lcdFill(COLOR_BLUE);
+	lcdSimPrintStats("lcdFill");
+
+	for (i=0; i<32*32; i++) // simple gradient
+		u16Tile[i] = (uint16_t)(((i & 31) << 11) | ((i >> 5) << 6));
+	lcdSimResetStats();
+	lcdDrawTile(4, 4, 32, 32, (unsigned char *)u16Tile, 64);
+	lcdSimPrintStats("lcdDrawTile 32x32");
+
+	lcdSimResetStats();
+	lcdWriteString(40, 4, "6x8 font", COLOR_WHITE, COLOR_BLUE, FONT_6x8);
+	lcdSimPrintStats("lcdWriteString 6x8");
+
+	lcdSimResetStats();
+	lcdWriteString(40, 16, "8x8 font", COLOR_YELLOW, COLOR_BLACK, FONT_8x8);
+	lcdSimPrintStats("lcdWriteString 8x8");
+
+	lcdSimResetStats();
+	lcdWriteString(40, 28, "12x16", COLOR_GREEN, COLOR_BLUE, FONT_12x16);
+	lcdSimPrintStats("lcdWriteString 12x16");
+
+	if (lcdSimDumpPPM(szOut) == 0)
+		printf("Saved %s (%llu ms simulated)\n", szOut, (unsigned long long)(lcdSimTimeNs() / 1000000));
+	return 0;
+} /* main() */
@@ -21,14 +21,133 @@
 #include "Arduino.h"
 #include "spi_lcd.h"
 
-static uint8_t u8CS, u8DC, u8BL;
-static uint8_t u8MADCTL; // original value
+static PINHANDLE phCS, phDC; // written directly in the hot paths
+static uint8_t u8BL;
 static int iCursorX, iCursorY;
-static int iNativeWidth, iNativeHeight, iNativeXOff, iNativeYOff, iLCDWidth, iLCDHeight, iLCDPitch, iLCDXOff, iLCDYOff;
-static uint8_t u8Cache0[CACHE_SIZE]; // ping-pong data buffers
-static uint8_t u8Cache1[CACHE_SIZE];
+static int iLCDWidth, iLCDHeight, iLCDPitch, iLCDXOff, iLCDYOff;
+static uint8_t u8ActiveMADCTL; // MADCTL of the current orientation
+static uint8_t u8Cache0[CACHE_SIZE] __attribute__((aligned(4))); // ping-pong data buffers
+static uint8_t u8Cache1[CACHE_SIZE] __attribute__((aligned(4)));
 static uint8_t *pCache0 = u8Cache0, *pCache1 = u8Cache1;
 volatile int bDMA = 0;
+static uint8_t *pDMAData; // next source address of the current DMA write
+static int iDMARemaining; // bytes left to queue after the current DMA block
+static LCD_DMA_CALLBACK pfnDMADone; // called from the ISR when the write finishes
+static void *pDMAUser;
+static void lcdDMANext(void);
+// commands needed by a new window
+#define WIN_CASET 1
+#define WIN_RASET 2
+#define WIN_RAMWR 4
+// SPI/DMA data width currently in use
+enum {
+	DMA_MODE_8BIT = 0,
+	DMA_MODE_16BIT,
+	DMA_MODE_REPEAT16
+};
+static int iDMAMode = DMA_MODE_8BIT;
+static int iDMAStep = 1; // source bytes consumed per DMA count
+static uint16_t u16FillColor; // repeated by DMA_MODE_REPEAT16
+// What the controller has been told, so repeated commands can be skipped
+static int iWinX0 = -1, iWinX1, iWinY0 = -1, iWinY1; // CASET/RASET (-1 = unknown)
+static int iCurMADCTL = -1;
+// How to wait for the DMA interrupt and what the waiting has cost
+static int iWaitMode = LCD_WAIT_SPIN;
+static LCD_YIELD_CALLBACK pfnWaitYield;
+static void *pWaitUser;
+static uint64_t u64WaitTicks;
+static uint32_t u32Waits;
+static int bRAMWR; // controller is in RAMWR; pixels land at u32WriteBytes/2
+static uint32_t u32WriteBytes;
+static uint32_t u32CmdsElided;
+// Boot time bookkeeping; the clock is kept in SysTick ticks and survives
+// the Delay_Us() calls (which reload SysTick) by adding their length
+static uint64_t u64BootClock, u64BootMark, u64BootDelay;
+static uint32_t u32BootHz; // SysTick rate during the last lcdInitEx()
+static uint32_t u32BootInitUs, u32BootFirstPixelUs;
+static int bBootFirstPixel; // waiting for the first pixel after lcdInit()
+// Reset/sleep timing of each controller family in microseconds
+typedef struct lcd_boot_timing_tag {
+	uint32_t u32ResetPulse;    // RESX low time
+	uint32_t u32ResetReady;    // from reset until other commands are accepted
+	uint32_t u32SleepOutReady; // from reset until SLPOUT may be sent
+	uint32_t u32SleepOutWait;  // from SLPOUT until the next command
+} LCDBOOTTIMING;
+static const LCDBOOTTIMING lcdBootSitronix = {10, 5000, 120000, 5000}; // ST7735S/ST7789V
+static const LCDBOOTTIMING lcdBootGC9107 = {10, 5000, 120000, 120000};
+// Command/data descriptors worked through by the DMA interrupt
+#define QUEUE_FLAG_CMD 1
+#define QUEUE_FLAG_PIXELS 2 // native RGB565 sent as 16-bit frames
+#define QUEUE_POLL_MAX 16 // shorter blocks are written directly instead of by DMA
+typedef struct lcd_queue_entry_tag {
+	uint8_t *pData; // data to send (NULL = u8Inline)
+	int iLen;
+	uint8_t u8Flags;
+	uint8_t u8CMD; // command byte sent first with DC low
+	uint8_t u8Inline[4]; // copy of short parameter lists
+} LCDQUEUEENTRY;
+static LCDQUEUEENTRY lcdQueue[LCD_QUEUE_SIZE];
+static volatile int iQueueHead, iQueueTail, bQueueActive;
+// Areas waiting for lcdFlush()
+typedef struct lcd_rect_tag {
+    int x0, y0, x1, y1; // x1/y1 are exclusive
+} LCDRECT;
+static LCDRECT dirtyRects[LCD_MAX_DIRTY];
+static int iDirtyCount;
+static LCDFLUSHSTATS flushStats;
+static int lcdGlyphRows(int iFontSize, uint8_t c, uint8_t pRows[16][2]);
+// Expanded RGB565 glyphs of lcdWriteStringCustom(), kept in LRU order
+typedef struct glyph_cache_entry_tag {
+    const GFXfont *pFont;
+    uint16_t u16Glyph;
+    uint16_t u16FG, u16BG;
+    uint8_t bBlank;  // full character cell instead of the glyph box
+    uint16_t u16Pixels;
+    uint32_t u32Offset; // into pGlyphCache (bytes)
+    uint32_t u32LastUse;
+} GLYPHCACHEENTRY;
+static GLYPHCACHEENTRY glyphCache[LCD_GLYPH_CACHE_ENTRIES];
+static uint8_t *pGlyphCache; // caller-supplied pixel storage
+static int iGlyphCacheSize, iGlyphCacheUsed, iGlyphCacheCount;
+static uint32_t u32GlyphTick;
+static LCDGLYPHCACHESTATS glyphStats;
+// Text console; rows are in screen order, the hardware scrolls the GRAM
+typedef struct lcd_console_tag {
+    int iFont, iCharW, iCharH;
+    int iCols, iRows, iCol, iRow; // size and cursor in characters
+    int iScroll;    // lines the scrolling area has moved (0..iAreaH-1)
+    int iAreaH;     // height of the scrolling area (whole text rows)
+    int iTFA;       // first GRAM row of the scrolling area
+    int bHWScroll;  // 0 = wrap back to the top instead of scrolling
+    int bYFlip;     // logical rows run up the GRAM
+    int bActive, bValid;
+    uint16_t u16FG, u16BG;
+} LCDCONSOLE;
+static LCDCONSOLE con;
+// Optional indexed-color framebuffer which the drawing functions render into
+static uint8_t *pFB;
+static const uint16_t *pFBPalette;
+static int bFBNearestValid; // lcdFBNearest()'s last match is for this palette
+static int iFBBpp, iFBPitch, iFBWidth, iFBHeight;
+static int iFBWinX, iFBWinY, iFBWinW, iFBWinH, iFBCurX, iFBCurY; // current window
+static int bFBBypass; // lcdFBFlush() is talking to the panel
+static uint32_t u32FBDirty[(320+31)/32]; // one bit per row
+static void lcdFBWritePixels(uint16_t *pPixels, int iCount);
+static void lcdFBFillRect(int x, int y, int w, int h, uint16_t u16Index);
+static void lcdFBDrawTile(int x, int y, int w, int h, uint8_t *pTile, int iPitch);
+// Background refresh; the DMA interrupt sends one band and fills the next
+static LCD_RENDER_CALLBACK pfnRefreshFill;
+static void *pRefreshUser;
+static LCD_DMA_CALLBACK pfnRefreshDone;
+static void *pRefreshDoneUser;
+static uint8_t *pRefreshBuf[2];
+static int iRefreshX, iRefreshY, iRefreshW, iRefreshH, iRefreshBandRows;
+static int iRefreshSendY, iRefreshSendBuf; // next band to send and the buffer holding it
+static volatile int bRefreshActive;
+static volatile uint32_t u32RefreshFrames;
+static void lcdQueueRun(void);
+static void lcdConsoleReset(void);
+static void lcdBootFirstPixel(void);
 
 const uint8_t uc240x240InitList[] = {
     1, 0x13, // partial mode off
@@ -99,6 +218,54 @@ const uint8_t uc128InitList[] = {
 				1, 0x29, // display on
         0
 };
+// 0.96" IPS version of the 80x160; the glass needs inverted colors
+const uint8_t uc80BInitList[] = {
+    2, 0x3a, 0x05,    // pixel format RGB565
+    2, 0x36, 0x68, // MADCTL (0/90/180/270 and color/inversion)
+    17, 0xe0, 0x09, 0x16, 0x09,0x20,
+    0x21,0x1b,0x13,0x19,
+    0x17,0x15,0x1e,0x2b,
+    0x04,0x05,0x02,0x0e, // gamma sequence
+    17, 0xe1, 0x0b,0x14,0x08,0x1e,
+    0x22,0x1d,0x18,0x1e,
+    0x1b,0x1a,0x24,0x2b,
+    0x06,0x06,0x02,0x0f,
+    1, 0x21,    // display inversion on
+	1, 0x29, // display on
+    0
+};
+
+//
+// Everything lcdInit() needs to know about a panel
+// Width/height/offsets are for ORIENTATION_0 with the given MADCTL value
+// (most panels start in landscape mode); u32MaxSpeed is the controller's
+// rated SPI write clock. With a speed of 0, lcdInit() uses the fastest
+// clock SPI1 can make (SystemCoreClock/2..256) which doesn't exceed it
+//
+typedef struct lcd_panel_tag {
+	int iWidth, iHeight;
+	int iXOff, iYOff;
+	uint8_t u8MADCTL;
+	int iGRAMHeight; // controller memory rows (the vertical scrolling direction)
+	uint32_t u32MaxSpeed;
+	const uint8_t *pInitList;
+	const LCDBOOTTIMING *pTiming;
+} LCDPANEL;
+
+static const LCDPANEL lcdPanels[LCD_COUNT] = {
+	{160, 80, 0, 24, 0x68, 162, 15000000, uc80InitList, &lcdBootSitronix},       // LCD_ST7735_80x160
+	{160, 80, 1, 26, 0x68, 162, 15000000, uc80BInitList, &lcdBootSitronix},      // LCD_ST7735_80x160_B
+	{128, 128, 1, 0, 0x68, 162, 15000000, uc128InitList, &lcdBootSitronix},      // LCD_ST7735_128x128
+	{160, 128, 0, 0, 0x60, 162, 15000000, uc160InitList, &lcdBootSitronix},      // LCD_ST7735_128x160
+	{240, 135, 40, 53, 0x60, 320, 62500000, uc240x240InitList, &lcdBootSitronix}, // LCD_ST7789_135x240
+	{320, 172, 0, 34, 0x60, 320, 62500000, uc240x240InitList, &lcdBootSitronix},  // LCD_ST7789_172x320
+	{240, 240, 0, 0, 0x60, 320, 62500000, uc240x240InitList, &lcdBootSitronix},   // LCD_ST7789_240x240
+	{280, 240, 20, 0, 0x60, 320, 62500000, uc240x240InitList, &lcdBootSitronix},  // LCD_ST7789_240x280
+	{320, 240, 0, 0, 0x60, 320, 62500000, uc240x240InitList, &lcdBootSitronix},   // LCD_ST7789_240x320
+	{128, 128, 1, 2, 0x68, 160, 50000000, uc240x240InitList, &lcdBootGC9107}      // LCD_GC9107_128x128
+};
+static const LCDPANEL *pPanel = &lcdPanels[0]; // the one passed to lcdInit()
+
 const uint8_t ucFont[]PROGMEM = {
   0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x06,0x5f,0x5f,0x06,0x00,
   0x00,0x07,0x07,0x00,0x07,0x07,0x00,0x14,0x7f,0x7f,0x14,0x7f,0x7f,0x14,
@@ -247,16 +414,140 @@ const uint8_t ucSmallFont[] PROGMEM = {
 0x02,0x01,0x02,0x01,0x00,
 0x3c,0x26,0x23,0x26,0x3c};
 
+//
+// Wait for the last bits to leave the shift register
+// (DMA completes when the last byte is written to DATAR)
+//
+static void lcdWaitSPI(void)
+{
+    while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_TXE) == RESET) {};
+    while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_BSY) == SET) {};
+} /* lcdWaitSPI() */
+
+//
+// Wait for *pFlag to clear (set by the main loop, cleared by the DMA
+// interrupt) using one of the LCD_WAIT_xxx strategies
+// WFI is entered with interrupts masked so that a completion between
+// the test and the WFI can't be missed; the pending interrupt still
+// wakes the core and is taken as soon as they are unmasked
+//
+static void lcdWaitFlag(volatile int *pFlag, int iMode)
+{
+    uint64_t u64Start;
+
+    if (!*pFlag) return; // nothing to wait for (the common case)
+    u64Start = SysTick_Read();
+    if (iMode == LCD_WAIT_YIELD && pfnWaitYield == NULL)
+        iMode = LCD_WAIT_SPIN;
+    while (*pFlag) {
+        if (iMode == LCD_WAIT_WFI) {
+            __disable_irq();
+            if (*pFlag)
+                __WFI();
+            __enable_irq();
+        } else if (iMode == LCD_WAIT_YIELD) {
+            (*pfnWaitYield)(pWaitUser);
+        }
+    }
+    u64WaitTicks += SysTick_Elapsed(u64Start);
+    u32Waits++;
+} /* lcdWaitFlag() */
+
+//
+// Choose how the driver waits for the SPI/DMA hardware (LCD_WAIT_xxx)
+// Returns the previous mode, so a single call can be wrapped in a
+// different strategy and the old one put back afterwards
+//
+int lcdSetWaitMode(int iMode)
+{
+    int iOld = iWaitMode;
+
+    if (iMode >= LCD_WAIT_SPIN && iMode < LCD_WAIT_COUNT)
+        iWaitMode = iMode;
+    return iOld;
+} /* lcdSetWaitMode() */
+
+//
+// Function called repeatedly by LCD_WAIT_YIELD (e.g. to run other work
+// or a scheduler); without one, LCD_WAIT_YIELD spins
+//
+void lcdSetYieldCallback(LCD_YIELD_CALLBACK pfnYield, void *pUser)
+{
+    pfnWaitYield = pfnYield;
+    pWaitUser = pUser;
+} /* lcdSetYieldCallback() */
+
+//
+// Time spent blocked on the hardware so far, in SysTick ticks
+// (SysTick_Hz() of them per second)
+//
+void lcdGetWaitStats(LCDWAITSTATS *pStats)
+{
+    pStats->u64Ticks = u64WaitTicks;
+    pStats->u32Waits = u32Waits;
+} /* lcdGetWaitStats() */
+
+void lcdResetWaitStats(void)
+{
+    u64WaitTicks = 0;
+    u32Waits = 0;
+} /* lcdResetWaitStats() */
+
+//
+// Switch SPI1 + DMA channel 3 between byte transfers and 16-bit frames
+// iDMAStep is the number of source bytes consumed per DMA count
+// In DMA_MODE_REPEAT16 the memory address doesn't increment, so a single
+// color value is repeated for the whole transfer. Must be called while idle.
+//
+static void lcdSetDMAMode(int iMode)
+{
+	uint32_t u32 = DMA1_Channel3->CFGR;
+
+	lcdWaitSPI(); // SPE can only be turned off when the last frame is gone
+	DMA_Cmd(DMA1_Channel3, DISABLE);
+	u32 &= ~(DMA_MemoryInc_Enable | DMA_PeripheralDataSize_HalfWord | DMA_MemoryDataSize_HalfWord);
+	SPI_Cmd(SPI1, DISABLE);
+	if (iMode == DMA_MODE_8BIT) {
+		SPI_DataSizeConfig(SPI1, SPI_DataSize_8b);
+		u32 |= DMA_MemoryInc_Enable;
+		iDMAStep = 1;
+	} else if (iMode == DMA_MODE_16BIT) {
+		SPI_DataSizeConfig(SPI1, SPI_DataSize_16b);
+		u32 |= (DMA_MemoryInc_Enable | DMA_PeripheralDataSize_HalfWord | DMA_MemoryDataSize_HalfWord);
+		iDMAStep = 2;
+	} else {
+		SPI_DataSizeConfig(SPI1, SPI_DataSize_16b);
+		u32 |= (DMA_PeripheralDataSize_HalfWord | DMA_MemoryDataSize_HalfWord);
+		iDMAStep = 0;
+	}
+	SPI_Cmd(SPI1, ENABLE);
+	DMA1_Channel3->CFGR = u32;
+	iDMAMode = iMode;
+} /* lcdSetDMAMode() */
+
 void DMA1_Channel3_IRQHandler(void) __attribute__((interrupt));
 
 void DMA1_Channel3_IRQHandler(void)
 {
+	LCD_DMA_CALLBACK pfnDone;
+
 	if(DMA_GetITStatus(DMA1_IT_TC3)) {
 		DMA_ClearITPendingBit(DMA1_IT_TC3);
 		DMA_Cmd(DMA1_Channel3, DISABLE);
-		//Delay_Ms(4); // this comes right before the data is completely written
-		digitalWrite(u8CS, 1); // de-activate CS
-		bDMA = 0; // no longer active transaction
+		if (iDMARemaining) { // more than 64K; keep CS active and send the next part
+			lcdDMANext();
+		} else if (bQueueActive) { // move on to the next descriptor
+			lcdQueueRun();
+		} else {
+			lcdWaitSPI(); // TC comes right before the data is completely written
+			pinSet(&phCS); // de-activate CS
+			bDMA = 0; // no longer active transaction
+			if (pfnDMADone) { // tell the owner that its buffer is free
+				pfnDone = pfnDMADone;
+				pfnDMADone = NULL;
+				(*pfnDone)(pDMAUser);
+			}
+		}
 	}
 	// clear all other flags
 	DMA1->INTFCR = DMA1_IT_GL3;
@@ -297,257 +588,917 @@ void DMA_Tx_Init(DMA_Channel_TypeDef *DMA_CHx, u32 ppadr, u32 memadr, u16 bufsiz
    	DMA_Cmd(DMA1_Channel3, ENABLE);
 } /* DMA_Tx_Init() */
 
+//
+// Keep the window state cache in step with the commands we send
+//
+static void lcdTrackCMD(uint8_t ucCMD)
+{
+	bRAMWR = 0; // any command ends a memory write
+	switch (ucCMD) {
+	case 0x01: // SW reset
+		iWinX0 = iWinY0 = iCurMADCTL = -1;
+		break;
+	case 0x2a:
+		iWinX0 = -1;
+		break;
+	case 0x2b:
+		iWinY0 = -1;
+		break;
+	case 0x36:
+		iCurMADCTL = -1;
+		break;
+	}
+} /* lcdTrackCMD() */
+
+static void lcdTrackData(int iBytes)
+{
+	if (bRAMWR) {
+		u32WriteBytes += iBytes;
+		if (bBootFirstPixel)
+			lcdBootFirstPixel();
+	}
+} /* lcdTrackData() */
+
+//
+// Decide which of CASET/RASET/RAMWR are needed for a new window
+// (x1,y1 are inclusive and include the panel offsets)
+// Nothing is needed if the controller's write pointer is already at the
+// start of a window with the same columns which covers the new rows
+//
+static int lcdWindowNeeds(int x0, int x1, int y0, int y1)
+{
+	int iNeeds = 0;
+	uint32_t u32Pixels;
+
+	if (bRAMWR && x0 == iWinX0 && x1 == iWinX1 && iWinY0 >= 0 && !(u32WriteBytes & 1)) {
+		u32Pixels = u32WriteBytes >> 1;
+		if ((u32Pixels % (x1 - x0 + 1)) == 0 && iWinY0 + (int)(u32Pixels / (x1 - x0 + 1)) == y0 && y1 <= iWinY1) {
+			u32CmdsElided += 3;
+			return 0; // continue right where the last write ended
+		}
+	}
+	if (x0 != iWinX0 || x1 != iWinX1)
+		iNeeds |= WIN_CASET;
+	else
+		u32CmdsElided++;
+	if (y0 != iWinY0 || y1 != iWinY1)
+		iNeeds |= WIN_RASET;
+	else
+		u32CmdsElided++;
+	return iNeeds | WIN_RAMWR;
+} /* lcdWindowNeeds() */
+
+//
+// Record the window after its commands have been sent/queued
+//
+static void lcdWindowSet(int x0, int x1, int y0, int y1, int iNeeds)
+{
+	if (iNeeds == 0) return; // the controller still has the older, taller window
+	iWinX0 = x0; iWinX1 = x1;
+	iWinY0 = y0; iWinY1 = y1;
+	if (iNeeds & WIN_RAMWR) {
+		bRAMWR = 1;
+		u32WriteBytes = 0;
+	}
+} /* lcdWindowSet() */
+
+//
+// Number of CASET/RASET/RAMWR/MADCTL commands skipped because they would
+// have set the controller to the state it was already in
+//
+uint32_t lcdCommandsElided(void)
+{
+	return u32CmdsElided;
+} /* lcdCommandsElided() */
+
 void lcdWriteCMD(uint8_t ucCMD)
 {
-	while (bDMA) {}; // wait for old transaction to complete
+	lcdTrackCMD(ucCMD);
+	lcdWaitFlag(&bDMA, iWaitMode); // wait for old transaction to complete
+	if (iDMAMode != DMA_MODE_8BIT)
+		lcdSetDMAMode(DMA_MODE_8BIT);
 	bDMA = 1;
-	digitalWrite(u8DC, 0);
-	digitalWrite(u8CS, 0);
+	pinClear(&phDC);
+	pinClear(&phCS);
 	SPI_write(&ucCMD, 1);
-	digitalWrite(u8CS, 1);
-	digitalWrite(u8DC, 1);
+	pinSet(&phCS);
+	pinSet(&phDC);
 	bDMA = 0;
 
 } /* lcdWriteCMD() */
 
-void lcdWriteDATA(uint8_t *pData, int iLen)
+//
+// Queue the next (up to 64K) block of the current DMA write
+//
+static void lcdDMANext(void)
+{
+	int iCount = iDMARemaining;
+
+	if (iCount > DMA_MAX_COUNT)
+		iCount = DMA_MAX_COUNT;
+	DMA1_Channel3->CNTR = iCount;
+	DMA1_Channel3->MADDR = (uintptr_t)pDMAData;
+	pDMAData += iCount * iDMAStep;
+	iDMARemaining -= iCount;
+	DMA_Cmd(DMA1_Channel3, ENABLE); // have DMA send the data
+} /* lcdDMANext() */
+
+//
+// Start a DMA write of iCount items in the current DMA mode
+// (the previous transfer must have finished)
+//
+static void lcdDMAStart(uint8_t *pData, int iCount, LCD_DMA_CALLBACK pfnDone, void *pUser)
+{
+	pinClear(&phCS); // activate CS
+	pDMAData = pData;
+	iDMARemaining = iCount;
+	pfnDMADone = pfnDone;
+	pDMAUser = pUser;
+	bDMA = 1; // set before starting so a fast completion IRQ can't be lost
+	lcdDMANext();
+} /* lcdDMAStart() */
+
+//
+// Send a block of bytes (DMA_MODE_8BIT) or RGB565 pixels (DMA_MODE_16BIT)
+// Long writes are sent by DMA straight from pData (RAM or FLASH) and this
+// function returns as soon as the transfer starts. If pData is the current
+// ping-pong buffer (pCache0), the buffers are swapped so that the caller can
+// prepare the next block right away. Any other buffer belongs to the DMA
+// until pfnDone is called (from the interrupt handler), lcdDMABusy()
+// returns 0 or the next LCD function is called. Short writes are polled.
+//
+static void lcdWriteBlock(uint8_t *pData, int iCount, int iMode, LCD_DMA_CALLBACK pfnDone, void *pUser)
 {
 	uint8_t *p;
-	while (bDMA) {}; // wait for old transaction to complete
-	if (iLen >= 320) {
-		digitalWrite(u8CS, 0); // activate CS
-		DMA1_Channel3->CNTR = iLen;
-		DMA1_Channel3->MADDR = (uint32_t)pCache0;
-		DMA_Cmd(DMA1_Channel3, ENABLE); // have DMA send the data
-		bDMA = 1; // tell our code that DMA is currently active for next time
-		// swap buffers
-		p = pCache0;
-		pCache0 = pCache1;
-		pCache1 = p;
+	lcdTrackData((iMode == DMA_MODE_8BIT) ? iCount : iCount*2);
+	lcdWaitFlag(&bDMA, iWaitMode); // wait for old transaction to complete
+	if (iDMAMode != iMode)
+		lcdSetDMAMode(iMode);
+	if (iCount * iDMAStep >= 320) {
+		lcdDMAStart(pData, iCount, pfnDone, pUser);
+		if (pData == pCache0) { // swap buffers
+			p = pCache0;
+			pCache0 = pCache1;
+			pCache1 = p;
+		}
 	} else {
-		digitalWrite(u8CS, 0);
-		SPI_write(pData, iLen);
-		digitalWrite(u8CS, 1);
+		pinClear(&phCS);
+		if (iMode == DMA_MODE_16BIT)
+			SPI_write16((uint16_t *)pData, iCount);
+		else
+			SPI_write(pData, iCount);
+		pinSet(&phCS);
+		if (pfnDone)
+			(*pfnDone)(pUser);
 	}
+} /* lcdWriteBlock() */
+
+void lcdWriteDATAAsync(uint8_t *pData, int iLen, LCD_DMA_CALLBACK pfnDone, void *pUser)
+{
+	lcdWriteBlock(pData, iLen, DMA_MODE_8BIT, pfnDone, pUser);
+} /* lcdWriteDATAAsync() */
+
+void lcdWriteDATA(uint8_t *pData, int iLen)
+{
+	lcdWriteBlock(pData, iLen, DMA_MODE_8BIT, NULL, NULL);
 } /* lcdWriteDATA() */
 
-void lcdInit(int iLCDType, uint32_t u32Speed, uint8_t u8CSPin, uint8_t u8DCPin, uint8_t u8RSTPin, uint8_t u8BLPin)
+//
+// Write native (little-endian) RGB565 pixels
+// SPI1 and the DMA use 16-bit frames which go out MSB first, so the
+// pixels don't need to be byte swapped. Commands are still sent as bytes.
+//
+void lcdWritePixels(uint16_t *pPixels, int iCount)
+{
+	if (pFB && !bFBBypass) {
+		lcdFBWritePixels(pPixels, iCount);
+		return;
+	}
+	lcdWriteBlock((uint8_t *)pPixels, iCount, DMA_MODE_16BIT, NULL, NULL);
+} /* lcdWritePixels() */
+
+int lcdDMABusy(void)
+{
+	return bDMA;
+} /* lcdDMABusy() */
+
+void lcdWaitDMA(void)
+{
+	lcdWaitFlag(&bDMA, iWaitMode);
+} /* lcdWaitDMA() */
+
+//
+// Wait for the DMA using a specific LCD_WAIT_xxx strategy
+//
+void lcdWaitDMAEx(int iMode)
+{
+	lcdWaitFlag(&bDMA, iMode);
+} /* lcdWaitDMAEx() */
+
+//
+// Advance the boot clock by the SysTick ticks since the last call
+// Returns the time since lcdInitEx() started in ticks
+//
+static uint64_t lcdBootTicks(void)
+{
+	uint64_t u64Now = SysTick_Read();
+
+	if (SysTick->CTLR & 0x10) // counting down (as Delay_Us() leaves it)
+		u64BootClock += u64BootMark - u64Now;
+	else
+		u64BootClock += u64Now - u64BootMark;
+	u64BootMark = u64Now;
+	return u64BootClock;
+} /* lcdBootTicks() */
+
+static uint64_t lcdBootUsToTicks(uint32_t u32Us)
+{
+	return (((uint64_t)u32Us * u32BootHz) + 999999) / 1000000;
+} /* lcdBootUsToTicks() */
+
+static uint32_t lcdBootTicksToUs(uint64_t u64Ticks)
+{
+	return (u32BootHz) ? (uint32_t)((u64Ticks * 1000000) / u32BootHz) : 0;
+} /* lcdBootTicksToUs() */
+
+//
+// Delay_Us() for at least u64Ticks which keeps the boot clock running
+// Delay_Us() counts SystemCoreClock/8000000 SysTick ticks per microsecond,
+// a little less than a microsecond at clocks which aren't a multiple
+// of 8MHz, so the count is rounded up from ticks, not from microseconds
+//
+static void lcdBootDelay(uint64_t u64Ticks)
+{
+	uint32_t u32PerUs = SystemCoreClock / 8000000;
+	uint32_t u32Us;
+
+	if (u32PerUs == 0) u32PerUs = 1;
+	u32Us = (uint32_t)((u64Ticks + u32PerUs - 1) / u32PerUs);
+	lcdBootTicks();
+	Delay_Us(u32Us);
+	u64Ticks = (uint64_t)u32Us * u32PerUs;
+	u64BootClock += u64Ticks;
+	u64BootDelay += u64Ticks;
+	u64BootMark = SysTick_Read();
+} /* lcdBootDelay() */
+
+//
+// Wait until the boot clock reaches u64Deadline (ticks)
+// The callback gets the time left to do other work; whatever remains
+// after it returns is spent in Delay_Us()
+//
+static void lcdBootWaitUntil(uint64_t u64Deadline, LCD_BOOT_CALLBACK pfnBoot, void *pUser)
+{
+	uint64_t u64Now;
+
+	lcdWaitFlag(&bDMA, iWaitMode); // the last command has to be out first
+	u64Now = lcdBootTicks();
+	if (u64Now >= u64Deadline) return;
+	if (pfnBoot) {
+		(*pfnBoot)(lcdBootTicksToUs(u64Deadline - u64Now), pUser);
+		u64Now = lcdBootTicks();
+		if (u64Now >= u64Deadline) return;
+	}
+	lcdBootDelay(u64Deadline - u64Now);
+} /* lcdBootWaitUntil() */
+
+//
+// Called by lcdTrackData() for the first pixel written after lcdInit()
+//
+static void lcdBootFirstPixel(void)
+{
+	bBootFirstPixel = 0;
+	u32BootFirstPixelUs = lcdBootTicksToUs(lcdBootTicks());
+} /* lcdBootFirstPixel() */
+
+void lcdInitEx(int iLCDType, uint32_t u32Speed, uint8_t u8CSPin, uint8_t u8DCPin, uint8_t u8RSTPin, uint8_t u8BLPin, int iFlags, LCD_BOOT_CALLBACK pfnBoot, void *pUser)
 {
 //    uint8_t iBGR = 0;
 	uint8_t *s = NULL;
 	int iCount;
+	uint8_t *pSavedFB;
+	uint64_t u64Reset = 0;
 
 	if (iLCDType < 0 || iLCDType >= LCD_COUNT) return;
-	switch (iLCDType) {
-	case LCD_ST7789_135x240:
-		iNativeWidth = iLCDWidth = 240; // initialize in landscape mode
-		iNativeHeight = iLCDHeight = 135;
-		iNativeXOff = iLCDXOff = 40;
-		iNativeYOff = iLCDYOff = 53;
-		u8MADCTL = 0x60;
-	    s = (unsigned char *)uc240x240InitList;
-		break;
-	case LCD_ST7789_172x320:
-		iNativeWidth = iLCDWidth = 320; // initialize in landscape mode
-		iNativeHeight = iLCDHeight = 172;
-		iNativeXOff = iLCDXOff = 0;
-		iNativeYOff = iLCDYOff = 34;
-		u8MADCTL = 0x60;
-	    s = (unsigned char *)uc240x240InitList;
-		break;
-	case LCD_ST7789_240x280:
-		iNativeWidth = iLCDWidth = 280; // initialize in landscape mode
-		iNativeHeight = iLCDHeight = 240;
-		iNativeXOff = iLCDXOff = 20;
-		iNativeYOff = iLCDYOff = 0;
-		u8MADCTL = 0x60;
-	    s = (unsigned char *)uc240x240InitList;
-		break;
-	case LCD_ST7735_80x160:
-		iNativeWidth = iLCDWidth = 160; // initialize in landscape mode
-		iNativeHeight = iLCDHeight = 80;
-		iNativeXOff = iLCDXOff = 0;
-		iNativeYOff = iLCDYOff = 24;
-		u8MADCTL = 0x68;
-	    s = (unsigned char *)uc80InitList;
-		break;
-	case LCD_GC9107_128x128:
-		iNativeWidth = iLCDWidth = 128;
-		iNativeHeight = iLCDHeight = 128;
-		iNativeXOff = iLCDXOff = 1;
-		iNativeYOff = iLCDYOff = 2;
-		u8MADCTL = 0x68;
-	    s = (unsigned char *)uc240x240InitList;
-		break;
-	case LCD_ST7735_128x128:
-		iNativeWidth = iLCDWidth = 128;
-		iNativeHeight = iLCDHeight = 128;
-		iNativeXOff = iLCDXOff = 1;
-		iNativeYOff = iLCDYOff = 0;
-		u8MADCTL = 0x68;
-	    s = (unsigned char *)uc128InitList;
-		break;
-	case LCD_ST7735_128x160:
-		iNativeWidth = iLCDWidth = 160;
-		iNativeHeight = iLCDHeight = 128;
-		iNativeXOff = iLCDXOff = 0;
-		iNativeYOff = iLCDYOff = 0;
-		u8MADCTL = 0x60;
-	    s = (unsigned char *)uc160InitList;
-		break;
-	} // switch on LCD type
+	u32BootHz = SysTick_Hz();
+	u64BootClock = u64BootDelay = 0;
+	u64BootMark = SysTick_Read();
+	bBootFirstPixel = 0;
+	u32BootFirstPixelUs = 0;
+	pPanel = &lcdPanels[iLCDType];
+	iLCDWidth = pPanel->iWidth;
+	iLCDHeight = pPanel->iHeight;
+	iLCDXOff = pPanel->iXOff;
+	iLCDYOff = pPanel->iYOff;
+	s = (uint8_t *)pPanel->pInitList;
+	if (u32Speed == 0) {
+		u32Speed = SystemCoreClock / 2;
+		while (u32Speed > pPanel->u32MaxSpeed && u32Speed > SystemCoreClock / 256)
+			u32Speed >>= 1;
+	}
 	iLCDPitch = iLCDWidth*2;
-	u8CS = u8CSPin;
+	pinGetHandle(u8CSPin, &phCS);
 	pinMode(u8CSPin, OUTPUT);
 	digitalWrite(u8CSPin, 1);
-	pinMode(u8RSTPin, OUTPUT);
-	digitalWrite(u8RSTPin, 0); // reset the display controller
-	Delay_Ms(100);
-	digitalWrite(u8RSTPin, 1);
-	Delay_Ms(200);
+	if (!(iFlags & LCD_INIT_FAST)) { // the original, generous timing
+		pinMode(u8RSTPin, OUTPUT);
+		digitalWrite(u8RSTPin, 0); // reset the display controller
+		lcdBootDelay(lcdBootUsToTicks(100000));
+		digitalWrite(u8RSTPin, 1);
+		lcdBootDelay(lcdBootUsToTicks(200000));
+	} else {
+		digitalWrite(u8RSTPin, 1); // idle level first, so pinMode() doesn't glitch it
+		pinMode(u8RSTPin, OUTPUT);
+		if (!(iFlags & (LCD_INIT_NO_HWRESET | LCD_INIT_NO_RESET))) {
+			digitalWrite(u8RSTPin, 0);
+			lcdBootDelay(lcdBootUsToTicks(pPanel->pTiming->u32ResetPulse));
+			digitalWrite(u8RSTPin, 1);
+			u64Reset = lcdBootTicks();
+		}
+	}
 
 	SPI_begin(u32Speed, 0);
-	u8DC = u8DCPin;
+	pinGetHandle(u8DCPin, &phDC);
 	pinMode(u8DCPin, OUTPUT);
 	u8BL = u8BLPin;
 	pinMode(u8BL, OUTPUT);
-	digitalWrite(u8BL, 1); // turn on backlight
+	DMA_Tx_Init(DMA1_Channel3, (uintptr_t)&SPI1->DATAR, (uintptr_t)pCache0, 0);
+	iDMAMode = DMA_MODE_8BIT; // SPI_begin() + DMA_Tx_Init() use byte transfers
+	iDMAStep = 1;
+	iDirtyCount = 0;
+	bRefreshActive = 0;
+	u32RefreshFrames = 0;
+	u8ActiveMADCTL = pPanel->u8MADCTL;
+	con.bActive = con.bValid = 0; // SW reset cleared the scrolling area
+	iWinX0 = iWinY0 = iCurMADCTL = -1; // nothing is known after a hardware reset either
+	bRAMWR = 0;
 //    if (pLCD->iLCDFlags & FLAGS_SWAP_RB)
 //        iBGR = 8;
-	lcdWriteCMD(0x01); // SW reset
-	Delay_Ms(200);
-	lcdWriteCMD(0x11); // sleep out
-	Delay_Ms(100);
+	if (!(iFlags & LCD_INIT_FAST)) {
+		digitalWrite(u8BL, 1); // turn on backlight
+		lcdWriteCMD(0x01); // SW reset
+		lcdBootDelay(lcdBootUsToTicks(200000));
+		lcdWriteCMD(0x11); // sleep out
+		lcdBootDelay(lcdBootUsToTicks(100000));
+	} else if (!(iFlags & LCD_INIT_NO_RESET)) {
+		// A hardware reset already did everything SWRESET does
+		if (iFlags & LCD_INIT_NO_HWRESET) {
+			lcdWriteCMD(0x01); // SW reset
+			u64Reset = lcdBootTicks();
+		}
+		lcdBootWaitUntil(u64Reset + lcdBootUsToTicks(pPanel->pTiming->u32ResetReady), pfnBoot, pUser);
+	}
     iCount = 1;
      while (s && iCount)
      {
 		 iCount = *s++;
 		 if (iCount != 0)
 		 {
-			 lcdWriteCMD(s[0]);
-			 lcdWriteDATA(&s[1], iCount-1);
+			 // in fast mode the list is sent while the controller is
+			 // still asleep; display on comes after sleep out
+			 if (!(iFlags & LCD_INIT_FAST) || s[0] != 0x29) {
+				 lcdWriteCMD(s[0]);
+				 lcdWriteDATA(&s[1], iCount-1);
+			 }
 			 s += iCount;
 		 } // if count
      }// while
-     DMA_Tx_Init(DMA1_Channel3, (u32)&SPI1->DATAR, (u32)pCache0, 0);
+	if (iFlags & LCD_INIT_FAST) {
+		if (iFlags & LCD_INIT_CLEAR) { // GRAM is writable in sleep mode and holds noise after a reset
+			pSavedFB = pFB;
+			pFB = NULL; // clear the panel, not an attached framebuffer
+			lcdFill(0);
+			pFB = pSavedFB;
+		}
+		if (!(iFlags & LCD_INIT_NO_RESET))
+			lcdBootWaitUntil(u64Reset + lcdBootUsToTicks(pPanel->pTiming->u32SleepOutReady), pfnBoot, pUser);
+		lcdWriteCMD(0x11); // sleep out
+		lcdBootWaitUntil(lcdBootTicks() + lcdBootUsToTicks(pPanel->pTiming->u32SleepOutWait), pfnBoot, pUser);
+		lcdWriteCMD(0x29); // display on
+		digitalWrite(u8BL, 1); // backlight last, so nothing unfinished is seen
+	}
+	lcdWaitFlag(&bDMA, iWaitMode);
+	u32BootInitUs = lcdBootTicksToUs(lcdBootTicks());
+	bBootFirstPixel = 1;
+} /* lcdInitEx() */
 
+void lcdInit(int iLCDType, uint32_t u32Speed, uint8_t u8CSPin, uint8_t u8DCPin, uint8_t u8RSTPin, uint8_t u8BLPin)
+{
+	lcdInitEx(iLCDType, u32Speed, u8CSPin, u8DCPin, u8RSTPin, u8BLPin, 0, NULL, NULL);
 } /* lcdInit() */
 
+//
+// Boot timing of the last lcdInit()/lcdInitEx()
+// u32FirstPixelUs stays 0 until something is drawn; it assumes nothing
+// reloads SysTick (e.g. Delay_Ms()) between init and the first draw
+//
+void lcdGetBootStats(LCDBOOTSTATS *pStats)
+{
+	pStats->u32InitUs = u32BootInitUs;
+	pStats->u32DelayUs = lcdBootTicksToUs(u64BootDelay);
+	pStats->u32FirstPixelUs = u32BootFirstPixelUs;
+} /* lcdGetBootStats() */
+
+//
+// The rotated orientations exchange the native width/height and X/Y
+// offsets; 180 degrees keeps them
+//
 void lcdOrientation(int iOrientation)
 {
-	uint8_t u8 = u8MADCTL; // original value
+	uint8_t u8 = pPanel->u8MADCTL; // original value
 
 	switch (iOrientation) {
 	case ORIENTATION_0: // use original MADCTL value
-		iLCDWidth = iNativeWidth;
-		iLCDHeight = iNativeHeight;
-		iLCDPitch = iLCDWidth * 2;
-		iLCDXOff = iNativeXOff;
-		iLCDYOff = iNativeYOff;
 		break;
 	case ORIENTATION_90:
 		u8 ^= MADCTL_XFLIP;
 		u8 ^= MADCTL_VFLIP;
-		iLCDWidth = iNativeHeight;
-		iLCDHeight = iNativeWidth;
-		iLCDPitch = iLCDWidth * 2;
-		iLCDXOff = iNativeYOff;
-		iLCDYOff = iNativeXOff;
 		break;
 	case ORIENTATION_180:
 		u8 ^= MADCTL_XFLIP;
 		u8 ^= MADCTL_YFLIP;
-		iLCDWidth = iNativeWidth;
-		iLCDHeight = iNativeHeight;
-		iLCDPitch = iLCDWidth * 2;
-		iLCDXOff = iNativeXOff;
-		iLCDYOff = iNativeYOff;
 		break;
 	case ORIENTATION_270:
 		u8 ^= MADCTL_YFLIP;
 		u8 ^= MADCTL_VFLIP;
-		iLCDWidth = iNativeHeight;
-		iLCDHeight = iNativeWidth;
-		iLCDPitch = iLCDWidth * 2;
-		iLCDXOff = iNativeYOff;
-		iLCDYOff = iNativeXOff;
 		break;
 	}
+	if ((u8 ^ pPanel->u8MADCTL) & MADCTL_VFLIP) {
+		iLCDWidth = pPanel->iHeight;
+		iLCDHeight = pPanel->iWidth;
+		iLCDXOff = pPanel->iYOff;
+		iLCDYOff = pPanel->iXOff;
+	} else {
+		iLCDWidth = pPanel->iWidth;
+		iLCDHeight = pPanel->iHeight;
+		iLCDXOff = pPanel->iXOff;
+		iLCDYOff = pPanel->iYOff;
+	}
+	iLCDPitch = iLCDWidth * 2;
+	 u8ActiveMADCTL = u8;
+	 lcdConsoleReset();
+	 if (u8 == iCurMADCTL) { // already set
+		 u32CmdsElided++;
+		 return;
+	 }
 	 lcdWriteCMD(0x36); // MADCTL
 	 lcdWriteDATA(&u8, 1);
+	 iCurMADCTL = u8;
 } /* lcdOrientation() */
 
+//
+// Prepare the 4 parameter bytes of CASET/RASET
+//
+static void lcdPackRange(uint8_t *pBuf, int iStart, int iLen)
+{
+     pBuf[0] = (unsigned char)(iStart >> 8);
+     pBuf[1] = (unsigned char)iStart;
+     iStart = iStart + iLen - 1;
+     pBuf[2] = (unsigned char)(iStart >> 8);
+     pBuf[3] = (unsigned char)iStart;
+} /* lcdPackRange() */
+
+//
+// Set the memory window and start a RAMWR
+// Commands which would repeat the controller's current state are skipped
+//
 void lcdSetPosition(int x, int y, int w, int h)
 {
-uint8_t ucBuf[8];
+uint8_t ucBuf[4];
+int iNeeds;
 
+     if (pFB && !bFBBypass) { // drawing into the framebuffer
+         iFBWinX = iFBCurX = x;
+         iFBWinY = iFBCurY = y;
+         iFBWinW = w;
+         iFBWinH = h;
+         return;
+     }
+     lcdWaitFlag(&bRefreshActive, iWaitMode); // the ping-pong buffers belong to the refresh
      x += iLCDXOff;
      y += iLCDYOff;
-     ucBuf[0] = (unsigned char)(x >> 8);
-     ucBuf[1] = (unsigned char)x;
-     x = x + w - 1;
-     ucBuf[2] = (unsigned char)(x >> 8);
-     ucBuf[3] = (unsigned char)x;
-     lcdWriteCMD(0x2a);
-     lcdWriteDATA(ucBuf, 4);
-     ucBuf[0] = (unsigned char)(y >> 8);
-     ucBuf[1] = (unsigned char)y;
-     y = y + h - 1;
-     ucBuf[2] = (unsigned char)(y >> 8);
-     ucBuf[3] = (unsigned char)y;
-     lcdWriteCMD(0x2b);
-     lcdWriteDATA(ucBuf, 4);
-     lcdWriteCMD(0x2c); // RAMWR
+     iNeeds = lcdWindowNeeds(x, x + w - 1, y, y + h - 1);
+     if (iNeeds & WIN_CASET) {
+         lcdPackRange(ucBuf, x, w);
+         lcdWriteCMD(0x2a);
+         lcdWriteDATA(ucBuf, 4);
+     }
+     if (iNeeds & WIN_RASET) {
+         lcdPackRange(ucBuf, y, h);
+         lcdWriteCMD(0x2b);
+         lcdWriteDATA(ucBuf, 4);
+     }
+     if (iNeeds & WIN_RAMWR)
+         lcdWriteCMD(0x2c); // RAMWR
+     lcdWindowSet(x, x + w - 1, y, y + h - 1, iNeeds);
 } /* lcdSetPosition() */
 
 //
-// Draw a NxN RGB565 tile
-// This reverses the pixel byte order and sets a memory "window"
-// of pixels so that the write can occur in one shot
+// Send queued descriptors until one needs DMA or the queue is empty
+// Called to start the queue and from the DMA interrupt to continue it
+//
+static void lcdQueueRun(void)
+{
+	LCDQUEUEENTRY *pEntry;
+	uint8_t *p;
+	int iLen, iMode;
+
+	while (iQueueTail != iQueueHead) {
+		pEntry = &lcdQueue[iQueueTail];
+		lcdWaitSPI(); // DC can't change while bits are still going out
+		if ((pEntry->u8Flags & QUEUE_FLAG_CMD) && iDMAMode != DMA_MODE_8BIT)
+			lcdSetDMAMode(DMA_MODE_8BIT);
+		if (pEntry->u8Flags & QUEUE_FLAG_CMD) {
+			pinClear(&phDC);
+			SPI_write(&pEntry->u8CMD, 1);
+			pinSet(&phDC);
+		}
+		iLen = pEntry->iLen;
+		iMode = (pEntry->u8Flags & QUEUE_FLAG_PIXELS) ? DMA_MODE_16BIT : DMA_MODE_8BIT;
+		if (iLen && iMode != iDMAMode)
+			lcdSetDMAMode(iMode);
+		if (iMode == DMA_MODE_16BIT)
+			iLen >>= 1; // count 16-bit frames
+		if (pEntry->pData && iLen > QUEUE_POLL_MAX) { // the ISR continues
+			pDMAData = pEntry->pData;
+			iDMARemaining = iLen;
+			iQueueTail = (iQueueTail + 1) & (LCD_QUEUE_SIZE-1);
+			lcdDMANext();
+			return;
+		}
+		p = (pEntry->pData) ? pEntry->pData : pEntry->u8Inline;
+		if (iMode == DMA_MODE_16BIT)
+			SPI_write16((uint16_t *)p, iLen);
+		else
+			SPI_write(p, iLen);
+		iQueueTail = (iQueueTail + 1) & (LCD_QUEUE_SIZE-1); // slot is free
+	}
+	lcdWaitSPI();
+	pinSet(&phCS);
+	bQueueActive = 0;
+	bDMA = 0;
+} /* lcdQueueRun() */
+
+//
+// Add a descriptor; it is sent once the queue is started (or is running)
+// Waits for a free slot if the queue is full
+//
+static void lcdQueuePush(uint8_t u8Flags, uint8_t u8CMD, uint8_t *pData, int iLen)
+{
+	LCDQUEUEENTRY *pEntry;
+
+	if (u8Flags & QUEUE_FLAG_CMD)
+		lcdTrackCMD(u8CMD);
+	else
+		lcdTrackData(iLen);
+	while (((iQueueHead + 1) & (LCD_QUEUE_SIZE-1)) == iQueueTail) {}; // wait for a free slot
+	pEntry = &lcdQueue[iQueueHead];
+	pEntry->u8Flags = u8Flags;
+	pEntry->u8CMD = u8CMD;
+	pEntry->iLen = iLen;
+	pEntry->pData = pData;
+	if (pData && (u8Flags & QUEUE_FLAG_CMD) && iLen <= (int)sizeof(pEntry->u8Inline)) {
+		memcpy(pEntry->u8Inline, pData, iLen); // the caller's copy may go away
+		pEntry->pData = NULL;
+	}
+	iQueueHead = (iQueueHead + 1) & (LCD_QUEUE_SIZE-1); // visible to the ISR now
+} /* lcdQueuePush() */
+
+//
+// Start working through the queue if it's idle
+//
+static void lcdQueueStart(void)
+{
+	if (!bQueueActive) {
+		lcdWaitFlag(&bDMA, iWaitMode); // a plain lcdWriteDATA() may still be running
+		if (iDMAMode != DMA_MODE_8BIT)
+			lcdSetDMAMode(DMA_MODE_8BIT);
+	}
+	NVIC_DisableIRQ(DMA1_Channel3_IRQn);
+	if (!bQueueActive && iQueueTail != iQueueHead) {
+		bQueueActive = 1;
+		bDMA = 1; // synchronous writes wait for the whole queue
+		pinClear(&phCS);
+		lcdQueueRun();
+	}
+	NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+} /* lcdQueueStart() */
+
+//
+// Queue a command and its parameters
+// Up to 4 parameter bytes are copied; longer lists must stay valid
+// until the queue has finished with them (lcdDMABusy() returns 0)
+//
+int lcdQueueCMD(uint8_t u8CMD, uint8_t *pParams, int iLen)
+{
+	if (iLen < 0 || (iLen && pParams == NULL)) return -1;
+	lcdQueuePush(QUEUE_FLAG_CMD, u8CMD, pParams, iLen);
+	lcdQueueStart();
+	return 0;
+} /* lcdQueueCMD() */
+
+//
+// Queue a block of data; it is sent (by DMA) straight from pData
+// so the buffer can't be changed until lcdDMABusy() returns 0
+//
+int lcdQueueDATA(uint8_t *pData, int iLen)
+{
+	if (pData == NULL || iLen <= 0) return -1;
+	lcdQueuePush(0, 0, pData, iLen);
+	lcdQueueStart();
+	return 0;
+} /* lcdQueueDATA() */
+
+static void lcdQueuePushPosition(int x, int y, int w, int h)
+{
+	uint8_t ucBuf[4];
+	int iNeeds;
+
+	x += iLCDXOff;
+	y += iLCDYOff;
+	iNeeds = lcdWindowNeeds(x, x + w - 1, y, y + h - 1);
+	if (iNeeds & WIN_CASET) {
+		lcdPackRange(ucBuf, x, w);
+		lcdQueuePush(QUEUE_FLAG_CMD, 0x2a, ucBuf, 4);
+	}
+	if (iNeeds & WIN_RASET) {
+		lcdPackRange(ucBuf, y, h);
+		lcdQueuePush(QUEUE_FLAG_CMD, 0x2b, ucBuf, 4);
+	}
+	if (iNeeds & WIN_RAMWR)
+		lcdQueuePush(QUEUE_FLAG_CMD, 0x2c, NULL, 0); // RAMWR
+	lcdWindowSet(x, x + w - 1, y, y + h - 1, iNeeds);
+} /* lcdQueuePushPosition() */
+
+int lcdQueueSetPosition(int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0) return -1;
+	lcdQueuePushPosition(x, y, w, h);
+	lcdQueueStart();
+	return 0;
+} /* lcdQueueSetPosition() */
+
+//
+// Queue a complete window + pixel update in one call
+// The pixels are native RGB565 (like lcdWritePixels()); they go out as
+// 16-bit SPI frames straight from pPixels, so the buffer must stay
+// unchanged until lcdDMABusy() returns 0
+//
+int lcdQueueTile(int x, int y, int w, int h, uint16_t *pPixels)
+{
+	if (w <= 0 || h <= 0 || pPixels == NULL) return -1;
+	lcdQueuePushPosition(x, y, w, h);
+	lcdQueuePush(QUEUE_FLAG_PIXELS, 0, (uint8_t *)pPixels, w*h*2);
+	lcdQueueStart();
+	return 0;
+} /* lcdQueueTile() */
+
+//
+// Draw a RGB565 image of any size (clipped to the display)
+// One memory window is set for the whole image and the pixel rows are
+// gathered into the ping-pong buffers one band at a time; the next band is
+// copied while DMA sends the previous one
 //
 int lcdDrawTile(int x, int y, int iTileWidth, int iTileHeight, unsigned char *pTile, int iPitch)
 {
-    int i, j;
-    uint16_t *s16, *d16;
+    int j, k, iRows, iBandRows;
+    uint8_t *d;
 
-    if (iTileWidth*iTileHeight*2 > CACHE_SIZE) {
-        return -1; // tile must fit in SPI cache
+    if (pTile == NULL || iTileWidth <= 0 || iTileHeight <= 0)
+        return -1;
+    if (x < 0) { // clip to the display
+        pTile -= x*2;
+        iTileWidth += x;
+        x = 0;
+    }
+    if (y < 0) {
+        pTile -= y*iPitch;
+        iTileHeight += y;
+        y = 0;
+    }
+    if (x + iTileWidth > iLCDWidth)
+        iTileWidth = iLCDWidth - x;
+    if (y + iTileHeight > iLCDHeight)
+        iTileHeight = iLCDHeight - y;
+    if (iTileWidth <= 0 || iTileHeight <= 0)
+        return 0; // nothing visible
+    if (pFB) {
+        lcdFBDrawTile(x, y, iTileWidth, iTileHeight, pTile, iPitch);
+        return 0;
     }
-    // First convert to big-endian order
-    d16 = (uint16_t *)pCache0;
-    for (j=0; j<iTileHeight; j++)
+    iBandRows = CACHE_SIZE / (iTileWidth*2);
+    lcdSetPosition(x, y, iTileWidth, iTileHeight);
+    for (j=0; j<iTileHeight; j += iRows)
     {
-        s16 = (uint16_t*)&pTile[j*iPitch];
-        for (i=0; i<iTileWidth; i++)
+        iRows = iTileHeight - j;
+        if (iRows > iBandRows)
+            iRows = iBandRows;
+        // 16-bit SPI frames send the pixels in their native order
+        d = pCache0; // DMA may still be reading the other buffer
+        for (k=0; k<iRows; k++)
         {
-            *d16++ = __builtin_bswap16(*s16++);
-        } // for i;
+            memcpy(d, pTile, iTileWidth*2);
+            d += iTileWidth*2;
+            pTile += iPitch;
+        } // for k
+        lcdWritePixels((uint16_t *)pCache0, iRows*iTileWidth);
     } // for j
-    lcdSetPosition(x, y, iTileWidth, iTileHeight);
-    lcdWriteDATA(pCache0, iTileWidth*iTileHeight*2);
     return 0;
 } /* lcdDrawTile() */
 
-void lcdFill(uint16_t usData)
+//
+// Draw generated content (gradients, gauges, ...) of any size
+// One memory window is set for the clipped region, then pfnRender fills
+// up to CACHED_LINES lines at a time in the free ping-pong buffer while
+// DMA sends the previous band
+//
+int lcdRenderRegion(int x, int y, int w, int h, LCD_RENDER_CALLBACK pfnRender, void *pUser)
+{
+    int j, iRows, iBandRows;
+
+    if (pfnRender == NULL)
+        return -1;
+    if (x < 0) { w += x; x = 0; } // clip to the display
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > iLCDWidth) w = iLCDWidth - x;
+    if (y + h > iLCDHeight) h = iLCDHeight - y;
+    if (w <= 0 || h <= 0)
+        return 0; // nothing visible
+    iBandRows = CACHE_SIZE / (w*2);
+    if (iBandRows > CACHED_LINES)
+        iBandRows = CACHED_LINES;
+    lcdSetPosition(x, y, w, h);
+    for (j=0; j<h; j += iRows) {
+        iRows = (h - j < iBandRows) ? h - j : iBandRows;
+        (*pfnRender)(x, y + j, w, iRows, (uint16_t *)pCache0, pUser);
+        lcdWritePixels((uint16_t *)pCache0, w * iRows);
+    }
+    return 0;
+} /* lcdRenderRegion() */
+
+//
+// Fill a rectangle with a solid color
+// SPI1 is switched to 16-bit frames and the DMA repeats a single color
+// value without incrementing, so even the whole display is one or two
+// transfers and no buffer needs to be prepared
+// Returns -1 for an invalid size and 0 otherwise, also when the rectangle
+// is completely clipped (like lcdDrawTile())
+//
+int lcdFillRect(int x, int y, int w, int h, uint16_t u16Color)
 {
-	int cx, cy;
-	uint16_t *d;
-
-    usData = (usData >> 8) | (usData << 8); // swap hi/lo byte for LCD
-    lcdSetPosition(0,0, iLCDWidth, iLCDHeight);
-    // fit within our temp buffer
-    for (cy = 0; cy < iLCDHeight; cy++) {
-    	if (cy < 2) { // both buffers need a copy
-    		d = (uint16_t *)pCache0; // pointer swapped after each write
-    		for (cx = 0; cx < iLCDWidth; cx++) {
-    			d[cx] = usData;
-    		}
-    	}
-        lcdWriteDATA(pCache0, iLCDWidth*2); // fill with data words
-   } // for y
+    int iCount;
+
+    if (w <= 0 || h <= 0)
+        return -1;
+    if (x < 0) { w += x; x = 0; } // clip to the display
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > iLCDWidth) w = iLCDWidth - x;
+    if (y + h > iLCDHeight) h = iLCDHeight - y;
+    if (w <= 0 || h <= 0)
+        return 0; // nothing visible
+    if (pFB) {
+        lcdFBFillRect(x, y, w, h, u16Color);
+        return 0;
+    }
+    lcdSetPosition(x, y, w, h);
+    iCount = w * h;
+    lcdTrackData(iCount * 2);
+    lcdWaitFlag(&bDMA, iWaitMode); // wait for RAMWR to go out
+    if (iDMAMode != DMA_MODE_REPEAT16)
+        lcdSetDMAMode(DMA_MODE_REPEAT16);
+    u16FillColor = u16Color; // 16-bit frames go out MSB first; no swap needed
+    pinClear(&phCS); // activate CS
+    pDMAData = (uint8_t *)&u16FillColor;
+    iDMARemaining = iCount;
+    pfnDMADone = NULL;
+    bDMA = 1;
+    lcdDMANext();
+    return 0;
+} /* lcdFillRect() */
 
+void lcdFill(uint16_t usData)
+{
+    lcdFillRect(0, 0, iLCDWidth, iLCDHeight, usData);
 } /* lcdFill() */
 
+//
+// 1-bpp to RGB565 expansion
+// A 16-entry table holds the 4 pixels of every nibble for the current
+// FG/BG pair; it's only rebuilt when the colors change. The table is
+// written as halfwords and read as 32-bit words so each nibble becomes
+// two word stores on any byte order.
+//
+typedef union expand_lut_tag {
+    uint32_t u32[2];
+    uint16_t u16[4];
+} EXPANDLUT;
+static EXPANDLUT expandLUT[16];
+static uint16_t u16LUTFG, u16LUTBG;
+static int bLUTValid;
+
+static void lcdExpandColors(uint16_t u16FG, uint16_t u16BG)
+{
+    int i, j;
+
+    if (bLUTValid && u16FG == u16LUTFG && u16BG == u16LUTBG)
+        return;
+    for (i=0; i<16; i++) {
+        for (j=0; j<4; j++)
+            expandLUT[i].u16[j] = (i & (8 >> j)) ? u16FG : u16BG;
+    }
+    u16LUTFG = u16FG;
+    u16LUTBG = u16BG;
+    bLUTValid = 1;
+} /* lcdExpandColors() */
+
+//
+// Unrolled rows of the fixed size fonts (the colors must already be set
+// and pDest must be 32-bit aligned); bits are MSB first
+//
+static void lcdExpandRow6(uint8_t u8Bits, uint32_t *pDest)
+{
+    pDest[0] = expandLUT[u8Bits >> 4].u32[0];
+    pDest[1] = expandLUT[u8Bits >> 4].u32[1];
+    pDest[2] = expandLUT[u8Bits & 0xf].u32[0];
+} /* lcdExpandRow6() */
+
+static void lcdExpandRow8(uint8_t u8Bits, uint32_t *pDest)
+{
+    pDest[0] = expandLUT[u8Bits >> 4].u32[0];
+    pDest[1] = expandLUT[u8Bits >> 4].u32[1];
+    pDest[2] = expandLUT[u8Bits & 0xf].u32[0];
+    pDest[3] = expandLUT[u8Bits & 0xf].u32[1];
+} /* lcdExpandRow8() */
+
+static void lcdExpandRow12(uint8_t u8Bits0, uint8_t u8Bits1, uint32_t *pDest)
+{
+    lcdExpandRow8(u8Bits0, pDest);
+    pDest[4] = expandLUT[u8Bits1 >> 4].u32[0];
+    pDest[5] = expandLUT[u8Bits1 >> 4].u32[1];
+} /* lcdExpandRow12() */
+
+//
+// Expand iCount pixels of MSB-first 1-bpp data starting iBitOff bits
+// into pSrc; 1 bits become u16FG, 0 bits u16BG
+// Whole source bytes are converted 8 pixels at a time with 32-bit
+// stores (16-bit stores if pDest isn't 32-bit aligned)
+//
+void lcdExpand1bpp(const uint8_t *pSrc, int iBitOff, int iCount, uint16_t *pDest, uint16_t u16FG, uint16_t u16BG)
+{
+    uint8_t uc;
+    uint32_t *d32;
+    const uint16_t *p;
+
+    lcdExpandColors(u16FG, u16BG);
+    pSrc += (iBitOff >> 3);
+    iBitOff &= 7;
+    if (iBitOff == 0 && ((uintptr_t)pDest & 3) == 0) { // font sized rows
+        if (iCount == 6) {
+            lcdExpandRow6(pSrc[0], (uint32_t *)pDest);
+            return;
+        } else if (iCount == 12) {
+            lcdExpandRow12(pSrc[0], pSrc[1], (uint32_t *)pDest);
+            return;
+        }
+    }
+    while (iCount > 0 && iBitOff != 0) { // get to a byte boundary
+        *pDest++ = (*pSrc & (0x80 >> iBitOff)) ? u16FG : u16BG;
+        iCount--;
+        if (++iBitOff == 8) {
+            iBitOff = 0;
+            pSrc++;
+        }
+    }
+    if (((uintptr_t)pDest & 3) == 0) {
+        d32 = (uint32_t *)pDest;
+        for (; iCount >= 8; iCount -= 8) {
+            lcdExpandRow8(*pSrc++, d32);
+            d32 += 4;
+        }
+        pDest = (uint16_t *)d32;
+    } else {
+        for (; iCount >= 8; iCount -= 8) {
+            uc = *pSrc++;
+            p = expandLUT[uc >> 4].u16;
+            pDest[0] = p[0]; pDest[1] = p[1]; pDest[2] = p[2]; pDest[3] = p[3];
+            p = expandLUT[uc & 0xf].u16;
+            pDest[4] = p[0]; pDest[5] = p[1]; pDest[6] = p[2]; pDest[7] = p[3];
+            pDest += 8;
+        }
+    }
+    if (iCount > 0) { // last partial byte
+        p = expandLUT[*pSrc >> 4].u16;
+        if (iCount > 4) {
+            pDest[0] = p[0]; pDest[1] = p[1]; pDest[2] = p[2]; pDest[3] = p[3];
+            pDest += 4;
+            iCount -= 4;
+            p = expandLUT[*pSrc & 0xf].u16;
+        }
+        while (iCount--)
+            *pDest++ = *p++;
+    }
+} /* lcdExpand1bpp() */
+
 //
 // Draw a 1-bpp pattern with the given color and translucency
 // 1 bits are drawn as color, 0 are transparent
@@ -557,9 +1508,8 @@ void lcdFill(uint16_t usData)
 //
 void spilcdDrawPattern(uint8_t *pPattern, int iSrcPitch, int iDestX, int iDestY, int iCX, int iCY, uint16_t usColor)
 {
-    int x, y;
-    uint8_t *s, uc, ucMask;
-    uint16_t *d, u16Clr;
+    int i, y, iRows, h;
+    uint16_t *d;
 
      if (iDestX+iCX > iLCDWidth) // trim to fit on display
          iCX = (iLCDWidth - iDestX);
@@ -567,43 +1517,29 @@ void spilcdDrawPattern(uint8_t *pPattern, int iSrcPitch, int iDestX, int iDestY,
          iCY = (iLCDHeight - iDestY);
      if (pPattern == NULL || iDestX < 0 || iDestY < 0 || iCX <=0 || iCY <= 0)
          return;
-       u16Clr = (usColor >> 8) | (usColor << 8); // swap low/high bytes
        lcdSetPosition(iDestX, iDestY, iCX, iCY);
-       for (y=0; y<iCY; y++)
+       iRows = CACHE_SIZE / (iCX * 2); // send as many lines at once as will fit
+       for (y=0; y<iCY; y += h)
        {
-         s = &pPattern[y * iSrcPitch];
-         ucMask = uc = 0;
+         h = (iCY - y < iRows) ? iCY - y : iRows;
          d = (uint16_t *)pCache0;
-         for (x=0; x<iCX; x++)
-         {
-             ucMask >>= 1;
-             if (ucMask == 0)
-             {
-                 ucMask = 0x80;
-                 uc = *s++;
-             }
-             if (uc & ucMask) // active pixel
-                *d++ = u16Clr;
-             else
-                *d++ = 0;
-         } // for x
-         lcdWriteDATA(pCache0, iCX*2);
+         for (i=0; i<h; i++)
+            lcdExpand1bpp(&pPattern[(y+i) * iSrcPitch], 0, iCX, &d[i*iCX], usColor, 0);
+         lcdWritePixels(d, iCX * h);
        } // for y
 } /* spilcdDrawPattern() */
 
 //
 // Draw a string of text with the built-in fonts
+// The text is built a band of scanlines at a time in the ping-pong
+// buffers, so any length of string can be drawn. Characters are
+// clipped to the display on all four edges.
 //
 int lcdWriteString(int x, int y, char *szMsg, uint16_t usFGColor, uint16_t usBGColor, int iFontSize)
 {
-int i, j, k, iLen;
-int iStride;
-uint8_t *s;
-uint16_t usFG = (usFGColor >> 8) | ((usFGColor & -1)<< 8);
-uint16_t usBG = (usBGColor >> 8) | ((usBGColor & -1)<< 8);
-uint16_t *usD;
-int cx;
-uint8_t *pFont;
+int i, iLen, cx, cy, ty, x0, x1, y0, y1, w, h, iRows, iTXStart, iTXEnd;
+uint8_t u8Rows[16][2], *pRow;
+uint16_t *usD, *d;
 
     if (iFontSize < 0 || iFontSize >= FONT_COUNT)
         return -1; // invalid size
@@ -611,96 +1547,205 @@ uint8_t *pFont;
         x = iCursorX;
     if (y == -1)
         y = iCursorY;
-    if (x < 0) return -1;
     iLen = strlen(szMsg);
-
-    if (iFontSize == FONT_12x16) {
-        if ((12*iLen) + x > iLCDWidth) iLen = (iLCDWidth - x)/12; // can't display it all
-        if (iLen < 0) return -1;
-        iStride = iLen*12;
-        lcdSetPosition(x, y, iStride, 16);
-        usD = (uint16_t *)pCache0;
-        for (i=0; i<iStride*16; i++)
-           usD[i] = usBG; // set to background color first
-        for (k = 0; k<8; k++) { // create a pair of scanlines from each original
-           uint8_t ucMask = (1 << k);
-           usD = (unsigned short *)&pCache0[k*iStride*4];
-           for (i=0; i<iLen; i++)
-           {
-               uint8_t c0, c1;
-               s = (uint8_t *)&ucSmallFont[((unsigned char)szMsg[i]-32) * 5];
-               for (j=1; j<6; j++)
-               {
-                   uint8_t ucMask1 = ucMask << 1;
-                   uint8_t ucMask2 = ucMask >> 1;
-                   c0 = s[j-1];
-                   if (c0 & ucMask)
-                      usD[0] = usD[1] = usD[iStride] = usD[iStride+1] = usFG;
-                   // test for smoothing diagonals
-                   if (j < 5) {
-                      c1 = s[j];
-                      if ((c0 & ucMask) && (~c1 & ucMask) && (~c0 & ucMask1) && (c1 & ucMask1)) { // first diagonal condition
-                          usD[iStride+2] = usFG;
-                      } else if ((~c0 & ucMask) && (c1 & ucMask) && (c0 & ucMask1) && (~c1 & ucMask1)) { // second condition
-                          usD[iStride+1] = usFG;
-                      }
-                      if ((c0 & ucMask2) && (~c1 & ucMask2) && (~c0 & ucMask) && (c1 & ucMask)) { // repeat for previous line
-                          usD[1] = usFG;
-                      } else if ((~c0 & ucMask2) && (c1 & ucMask2) && (c0 & ucMask) && (~c1 & ucMask)) {
-                          usD[2] = usFG;
-                      }
-                   }
-                   usD+=2;
-               } // for j
-               usD += 2; // leave "6th" column blank
-            } // for each character
-        } // for each scanline
-        lcdWriteDATA(pCache0, iStride*32);
-        return 0;
-    } // 12x16
-
-    cx = (iFontSize == FONT_8x8) ? 8:6;
-    pFont = (iFontSize == FONT_8x8) ? (uint8_t *)ucFont : (uint8_t *)ucSmallFont;
-    if ((cx*iLen) + x > iLCDWidth) iLen = (iLCDWidth - x)/cx; // can't display it all
-    iStride = iLen * cx*2;
-    for (i=0; i<iLen; i++)
-    {
-        s = &pFont[((unsigned char)szMsg[i]-32) * (cx-1)];
-        uint8_t ucMask = 1;
-        for (k=0; k<8; k++) // for each scanline
-        {
-            usD = (unsigned short *)&pCache0[(k*iStride) + (i * cx*2)];
-            for (j=0; j<cx-1; j++)
-            {
-                if (s[j] & ucMask)
-                    *usD++ = usFG;
-                else
-                    *usD++ = usBG;
-            } // for j
-	    *usD++ = usBG; // blank column
-            ucMask <<= 1;
-        } // for k
-    } // for i
-    // write the data in one shot
-    lcdSetPosition(x, y, cx*iLen, 8);
-    lcdWriteDATA(pCache0, iLen*cx*16);
+    cx = (iFontSize == FONT_12x16) ? 12 : ((iFontSize == FONT_8x8) ? 8 : 6);
+    cy = (iFontSize == FONT_12x16) ? 16 : 8;
     iCursorX = x + (cx*iLen);
     iCursorY = y;
+    // visible part of the string
+    x0 = (x < 0) ? 0 : x;
+    x1 = (x + cx*iLen > iLCDWidth) ? iLCDWidth : x + cx*iLen;
+    y0 = (y < 0) ? 0 : y;
+    y1 = (y + cy > iLCDHeight) ? iLCDHeight : y + cy;
+    w = x1 - x0;
+    if (w <= 0 || y1 <= y0)
+        return -1; // nothing to see
+    iRows = CACHE_SIZE / (w * 2);
+    lcdSetPosition(x0, y0, w, y1 - y0);
+    for (; y0 < y1; y0 += h) {
+        h = (y1 - y0 < iRows) ? y1 - y0 : iRows;
+        usD = (uint16_t *)pCache0; // the other buffer may still be sending
+        for (i=(x0 - x)/cx; i<iLen && x + i*cx < x1; i++) {
+            lcdGlyphRows(iFontSize, (uint8_t)szMsg[i], u8Rows);
+            lcdExpandColors(usFGColor, usBGColor);
+            iTXStart = (x + i*cx < x0) ? x0 - (x + i*cx) : 0;
+            iTXEnd = (x + (i+1)*cx > x1) ? x1 - (x + i*cx) : cx;
+            for (ty=0; ty<h; ty++) {
+                pRow = u8Rows[y0 + ty - y];
+                d = &usD[ty*w + (x + i*cx - x0)];
+                if (iTXStart == 0 && iTXEnd == cx && ((uintptr_t)d & 3) == 0) {
+                    if (cx == 6) lcdExpandRow6(pRow[0], (uint32_t *)d);
+                    else if (cx == 8) lcdExpandRow8(pRow[0], (uint32_t *)d);
+                    else lcdExpandRow12(pRow[0], pRow[1], (uint32_t *)d);
+                } else { // clipped or unaligned
+                    lcdExpand1bpp(pRow, iTXStart, iTXEnd - iTXStart, &d[iTXStart], usFGColor, usBGColor);
+                }
+            } // for ty
+        } // for each visible character
+        lcdWritePixels(usD, w * h);
+    } // for each band
     return 0;
 } /* lcdWriteString() */
 
+//
+// Give the glyph cache a RAM budget (NULL or 0 bytes disables it)
+// The buffer should be 4-byte aligned; cached glyphs are sent straight
+// from it by DMA, so it must stay valid while the cache is in use
+//
+void lcdGlyphCacheInit(uint8_t *pBuffer, int iSize)
+{
+    lcdWaitDMA(); // the old buffer may still be sending
+    pGlyphCache = (iSize > 0) ? pBuffer : NULL;
+    iGlyphCacheSize = (pGlyphCache) ? iSize : 0;
+    lcdGlyphCacheClear();
+} /* lcdGlyphCacheInit() */
+
+void lcdGlyphCacheClear(void)
+{
+    iGlyphCacheUsed = iGlyphCacheCount = 0;
+    u32GlyphTick = 0;
+    memset(&glyphStats, 0, sizeof(glyphStats));
+} /* lcdGlyphCacheClear() */
+
+void lcdGetGlyphCacheStats(LCDGLYPHCACHESTATS *pStats)
+{
+    if (pStats == NULL) return;
+    glyphStats.iEntries = iGlyphCacheCount;
+    glyphStats.iBytesUsed = iGlyphCacheUsed;
+    *pStats = glyphStats;
+} /* lcdGetGlyphCacheStats() */
+
+static uint16_t *lcdGlyphCacheFind(const GFXfont *pFont, int iGlyph, uint16_t u16FG, uint16_t u16BG, int bBlank)
+{
+    int i;
+    GLYPHCACHEENTRY *pEntry;
+
+    for (i=0; i<iGlyphCacheCount; i++) {
+        pEntry = &glyphCache[i];
+        if (pEntry->pFont == pFont && pEntry->u16Glyph == iGlyph && pEntry->u16FG == u16FG &&
+            pEntry->u16BG == u16BG && pEntry->bBlank == bBlank) {
+            pEntry->u32LastUse = ++u32GlyphTick;
+            glyphStats.u32Hits++;
+            return (uint16_t *)&pGlyphCache[pEntry->u32Offset];
+        }
+    }
+    glyphStats.u32Misses++;
+    return NULL;
+} /* lcdGlyphCacheFind() */
+
+//
+// Remove the least recently used glyph and close the gap it leaves
+// so that the free space is always one block at the end of the buffer
+//
+static void lcdGlyphCacheEvict(void)
+{
+    int i, iLRU = 0;
+    uint32_t u32Size, u32Offset;
+
+    for (i=1; i<iGlyphCacheCount; i++) {
+        if (glyphCache[i].u32LastUse < glyphCache[iLRU].u32LastUse)
+            iLRU = i;
+    }
+    lcdWaitDMA(); // a cached glyph may still be sending
+    u32Offset = glyphCache[iLRU].u32Offset;
+    u32Size = ((glyphCache[iLRU].u16Pixels * 2) + 3) & ~3;
+    memmove(&pGlyphCache[u32Offset], &pGlyphCache[u32Offset + u32Size], iGlyphCacheUsed - (u32Offset + u32Size));
+    iGlyphCacheUsed -= u32Size;
+    for (i=0; i<iGlyphCacheCount; i++) {
+        if (glyphCache[i].u32Offset > u32Offset)
+            glyphCache[i].u32Offset -= u32Size;
+    }
+    glyphCache[iLRU] = glyphCache[--iGlyphCacheCount];
+    glyphStats.u32Evictions++;
+} /* lcdGlyphCacheEvict() */
+
+static uint16_t *lcdGlyphCacheAdd(const GFXfont *pFont, int iGlyph, uint16_t u16FG, uint16_t u16BG, int bBlank, int iPixels)
+{
+    GLYPHCACHEENTRY *pEntry;
+    int iSize = ((iPixels * 2) + 3) & ~3; // keep entries 4-byte aligned
+
+    if (iSize > iGlyphCacheSize || iPixels > 0xffff)
+        return NULL; // will never fit
+    while (iGlyphCacheCount == LCD_GLYPH_CACHE_ENTRIES || iGlyphCacheUsed + iSize > iGlyphCacheSize)
+        lcdGlyphCacheEvict();
+    pEntry = &glyphCache[iGlyphCacheCount++];
+    pEntry->pFont = pFont;
+    pEntry->u16Glyph = (uint16_t)iGlyph;
+    pEntry->u16FG = u16FG;
+    pEntry->u16BG = u16BG;
+    pEntry->bBlank = (uint8_t)bBlank;
+    pEntry->u16Pixels = (uint16_t)iPixels;
+    pEntry->u32Offset = iGlyphCacheUsed;
+    pEntry->u32LastUse = ++u32GlyphTick;
+    iGlyphCacheUsed += iSize;
+    return (uint16_t *)&pGlyphCache[pEntry->u32Offset];
+} /* lcdGlyphCacheAdd() */
+
+//
+// Expand an unclipped glyph into RGB565 pixels
+// bBlank produces the full xAdvance-wide cell drawn by the bBlank path,
+// otherwise just the glyph box
+//
+static void lcdExpandGlyph(const uint8_t *s, GFXglyph *pGlyph, uint16_t *d, uint16_t usFGColor, uint16_t usBGColor, int bBlank)
+{
+    int tx, ty;
+
+    for (ty=0; ty<pGlyph->height; ty++) {
+        if (bBlank) {
+            for (tx=0; tx<pGlyph->xOffset; tx++)
+                *d++ = usBGColor;
+        }
+        lcdExpand1bpp(s, ty * pGlyph->width, pGlyph->width, d, usFGColor, usBGColor);
+        d += pGlyph->width;
+        if (bBlank) {
+            for (tx=pGlyph->xOffset + pGlyph->width; tx<pGlyph->xAdvance; tx++)
+                *d++ = usBGColor;
+        }
+    }
+} /* lcdExpandGlyph() */
+
+//
+// Draw a glyph from the cache (expanding it on a miss)
+// Returns 0 if the glyph is clipped or can't be cached so the caller
+// has to draw it the slow way
+//
+static int lcdDrawCachedGlyph(GFXfont *pFont, int c, GFXglyph *pGlyph, int x, int y, uint16_t usFGColor, uint16_t usBGColor, int bBlank)
+{
+    int dx, dy, cx, cy;
+    uint16_t *p;
+
+    if (pGlyphCache == NULL || usFGColor == usBGColor)
+        return 0; // cache is off or transparent text
+    dx = (bBlank) ? x : x + pGlyph->xOffset;
+    dy = y + pGlyph->yOffset;
+    cx = (bBlank) ? pGlyph->xAdvance : pGlyph->width;
+    cy = pGlyph->height;
+    if (dx < 0 || dy < 0 || dx + cx > iLCDWidth || dy + cy > iLCDHeight || cx == 0 || cy == 0)
+        return 0; // clipped (or empty)
+    if (bBlank && (pGlyph->xOffset < 0 || pGlyph->xOffset + pGlyph->width > pGlyph->xAdvance))
+        return 0; // glyph sticks out of its cell
+    p = lcdGlyphCacheFind(pFont, c, usFGColor, usBGColor, bBlank);
+    if (p == NULL) {
+        p = lcdGlyphCacheAdd(pFont, c, usFGColor, usBGColor, bBlank, cx * cy);
+        if (p == NULL)
+            return 0;
+        lcdExpandGlyph(pFont->bitmap + pGlyph->bitmapOffset, pGlyph, p, usFGColor, usBGColor, bBlank);
+    }
+    lcdSetPosition(dx, dy, cx, cy);
+    lcdWritePixels(p, cx * cy); // one window + one write
+    return 1;
+} /* lcdDrawCachedGlyph() */
+
 //
 // Draw a string in a proportional font you supply
 //
 int lcdWriteStringCustom(GFXfont *pFont, int x, int y, char *szMsg, uint16_t usFGColor, uint16_t usBGColor, int bBlank)
 {
-int i, /*j, iLen, */ k, dx, dy, cx, cy, c, iBitOff;
+int i, dx, dy, cx, cy, c, iBitOff;
 int tx, ty;
 uint8_t *s, bits, uc;
 GFXfont font;
 GFXglyph glyph, *pGlyph;
-#define TEMP_BUF_SIZE 64
-#define TEMP_HIGHWATER (TEMP_BUF_SIZE-8)
 uint16_t *d;
 
    if (pFont == NULL)
@@ -714,8 +1759,6 @@ uint16_t *d;
    // in case of running on AVR, get copy of data from FLASH
    memcpy(&font, pFont, sizeof(font));
    pGlyph = &glyph;
-   usFGColor = (usFGColor >> 8) | (usFGColor << 8); // swap h/l bytes
-   usBGColor = (usBGColor >> 8) | (usBGColor << 8);
 
    i = 0;
    while (szMsg[i] && x < iLCDWidth)
@@ -725,6 +1768,10 @@ uint16_t *d;
          continue; // skip it
       c -= font.first; // first char of font defined
       memcpy_P(&glyph, &font.glyph[c], sizeof(glyph));
+      if (lcdDrawCachedGlyph(pFont, c, pGlyph, x, y, usFGColor, usBGColor, bBlank)) {
+         x += pGlyph->xAdvance;
+         continue;
+      }
       // set up the destination window (rectangle) on the display
       dx = x + pGlyph->xOffset; // offset from character UL to start drawing
       dy = y + pGlyph->yOffset;
@@ -746,10 +1793,8 @@ uint16_t *d;
       bits = uc = 0; // bits left in this font byte
 
       if (bBlank) { // erase the areas around the char to not leave old bits
-         int miny, maxy;
-         c = '0' - font.first;
+         int miny, maxy, iLeft, iSkip, iGlyphW, iLines, h, j;
          miny = y + pGlyph->yOffset;
-         c = 'y' - font.first;
          maxy = miny + pGlyph->height;
          if (maxy > iLCDHeight)
             maxy = iLCDHeight;
@@ -757,47 +1802,29 @@ uint16_t *d;
          if (cx + x > iLCDWidth) {
             cx = iLCDWidth - x;
          }
+         if (cx <= 0 || maxy <= miny) {
+            x += pGlyph->xAdvance;
+            continue;
+         }
          lcdSetPosition(x, miny, cx, maxy-miny);
-            // blank out area above character
-//            cy = font.yAdvance - pGlyph->height;
-//            for (ty=miny; ty<miny+cy && ty < maxy; ty++) {
-//               for (tx=0; tx<cx; tx++)
-//                  u16Temp[tx] = usBGColor;
-//               myspiWrite(pLCD, (uint8_t *)u16Temp, cx*sizeof(uint16_t), MODE_DATA, iFlags);
-//            } // for ty
-            // character area (with possible padding on L+R)
-            for (ty=0; ty<pGlyph->height && ty+miny < maxy; ty++) {
-               d = (uint16_t *)pCache0;
-               for (tx=0; tx<pGlyph->xOffset && tx < cx; tx++) { // left padding
-                  *d++ = usBGColor;
-               }
-            // character bitmap (center area)
-               for (tx=0; tx<pGlyph->width; tx++) {
-                  if (bits == 0) { // need more data
-                     uc = s[iBitOff>>3];
-                     bits = 8;
-                     iBitOff += bits;
-                  }
-                  if (tx + pGlyph->xOffset < cx) {
-                     *d++ = (uc & 0x80) ? usFGColor : usBGColor;
-                  }
-                  bits--;
-                  uc <<= 1;
-               } // for tx
-               // right padding
-               k = pGlyph->xAdvance - (int)(d - (uint16_t*)pCache0); // remaining amount
-               for (tx=0; tx<k && (tx+pGlyph->xOffset+pGlyph->width) < cx; tx++)
-                  *d++ = usBGColor;
-               lcdWriteDATA(pCache0, cx*sizeof(uint16_t));
-            } // for ty
-            // padding below the current character
-            ty = y + pGlyph->yOffset + pGlyph->height;
-            for (; ty < maxy; ty++) {
-            	d = (uint16_t *)pCache0;
+         // character area (with possible padding on L+R)
+         iLeft = (pGlyph->xOffset > 0) ? pGlyph->xOffset : 0;
+         iSkip = iLeft - pGlyph->xOffset; // glyph pixels left of the cell
+         iGlyphW = pGlyph->width - iSkip;
+         if (iLeft + iGlyphW > cx)
+            iGlyphW = cx - iLeft;
+         iLines = CACHE_SIZE / (cx*2);
+         for (ty=0; ty<maxy-miny; ty += h) {
+            h = (maxy - miny - ty < iLines) ? maxy - miny - ty : iLines;
+            d = (uint16_t *)pCache0;
+            for (j=0; j<h; j++, d += cx) {
                for (tx=0; tx<cx; tx++)
                   d[tx] = usBGColor;
-               lcdWriteDATA(pCache0, cx*sizeof(uint16_t));
-            } // for ty
+               if (iGlyphW > 0)
+                  lcdExpand1bpp(s, (ty+j)*pGlyph->width + iSkip, iGlyphW, &d[iLeft], usFGColor, usBGColor);
+            }
+            lcdWritePixels((uint16_t *)pCache0, cx*h);
+         } // for ty
       } else if (usFGColor == usBGColor) { // transparent
           int iCount; // opaque pixel count
           d = (uint16_t*)pCache0;
@@ -818,8 +1845,7 @@ uint16_t *d;
                     } else { // any opaque pixels to write?
                         if (iCount) {
                             lcdSetPosition(dx+tx-iCount, dy+ty, iCount, 1);
-                       d = (uint16_t *)pCache0; // point to start of output buffer
-                          lcdWriteDATA(pCache0, iCount*sizeof(uint16_t));
+                            lcdWritePixels((uint16_t *)pCache0, iCount);
                             iCount = 0;
                         } // if opaque pixels to write
                     } // if transparent pixel hit
@@ -827,34 +1853,29 @@ uint16_t *d;
                 bits--; // next bit
                 uc <<= 1;
              } // for tx
+             if (iCount) { // run touching the right edge
+                tx = (pGlyph->width < cx) ? pGlyph->width : cx;
+                lcdSetPosition(dx+tx-iCount, dy+ty, iCount, 1);
+                lcdWritePixels((uint16_t *)pCache0, iCount);
+                iCount = 0;
+             }
              } // for ty
        // quicker drawing
       } else { // just draw the current character box fast
+         int iLines, h, j;
+         if (cx <= 0 || cy <= 0) {
+            x += pGlyph->xAdvance;
+            continue;
+         }
          lcdSetPosition(dx, dy, cx, cy);
-            d = (uint16_t *)pCache0; // point to start of output buffer
-            for (ty=0; ty<cy; ty++) {
-            for (tx=0; tx<pGlyph->width; tx++) {
-               if (bits == 0) { // need to read more font data
-                  uc = s[iBitOff>>3]; // get more font bitmap data
-                  bits = 8 - (iBitOff & 7); // we might not be on a byte boundary
-                  iBitOff += bits; // because of a clipped line
-                  uc <<= (8-bits);
-                  k = (int)(d-(uint16_t*)pCache0); // number of words in output buffer
-                  if (k >= TEMP_HIGHWATER) { // time to write it
-                     lcdWriteDATA(pCache0, k*sizeof(uint16_t));
-                     d = (uint16_t*)pCache0;
-                  }
-               } // if we ran out of bits
-               if (tx < cx) {
-                  *d++ = (uc & 0x80) ? usFGColor : usBGColor;
-               }
-               bits--; // next bit
-               uc <<= 1;
-            } // for tx
-            } // for ty
-            k = (int)(d-(uint16_t*)pCache0);
-            if (k) // write any remaining data
-               lcdWriteDATA(pCache0, k*sizeof(uint16_t));
+         iLines = CACHE_SIZE / (cx*2); // send as many lines at once as will fit
+         for (ty=0; ty<cy; ty += h) {
+            h = (cy - ty < iLines) ? cy - ty : iLines;
+            d = (uint16_t *)pCache0;
+            for (j=0; j<h; j++)
+               lcdExpand1bpp(s, iBitOff + (ty+j)*pGlyph->width, cx, &d[j*cx], usFGColor, usBGColor);
+            lcdWritePixels((uint16_t *)pCache0, cx*h);
+         } // for ty
       } // quicker drawing
       x += pGlyph->xAdvance; // width of this character
    } // while drawing characters
@@ -863,3 +1884,1357 @@ uint16_t *d;
    return 0;
 } /* lcdWriteStringCustom() */
 
+//
+// Create the 1-bpp image of a built-in font character
+// Each row is stored as 2 bytes, MSB first (leftmost pixel = bit 7 of the
+// first byte). Returns the cell width; the cell height is 8 or 16.
+// FONT_12x16 is the 6x8 font doubled with the same diagonal smoothing
+// as lcdWriteString()
+//
+static int lcdGlyphRows(int iFontSize, uint8_t c, uint8_t pRows[16][2])
+{
+    int j, k, cx;
+    uint8_t *s, c0, c1, ucMask, ucMask1, ucMask2;
+    uint16_t u16Rows[16];
+
+    if (c < 32 || c > 127) c = 32;
+    memset(u16Rows, 0, sizeof(u16Rows));
+    if (iFontSize == FONT_12x16) {
+        s = (uint8_t *)&ucSmallFont[(c-32) * 5];
+        for (k=0; k<8; k++) {
+            ucMask = (1 << k);
+            ucMask1 = ucMask << 1;
+            ucMask2 = ucMask >> 1;
+            for (j=1; j<6; j++) {
+                c0 = s[j-1];
+                if (c0 & ucMask) {
+                    u16Rows[k*2] |= (0xc000 >> ((j-1)*2));
+                    u16Rows[k*2+1] |= (0xc000 >> ((j-1)*2));
+                }
+                if (j < 5) { // smooth the diagonals
+                    c1 = s[j];
+                    if ((c0 & ucMask) && (~c1 & ucMask) && (~c0 & ucMask1) && (c1 & ucMask1))
+                        u16Rows[k*2+1] |= (0x8000 >> (j*2));
+                    else if ((~c0 & ucMask) && (c1 & ucMask) && (c0 & ucMask1) && (~c1 & ucMask1))
+                        u16Rows[k*2+1] |= (0x8000 >> (j*2-1));
+                    if ((c0 & ucMask2) && (~c1 & ucMask2) && (~c0 & ucMask) && (c1 & ucMask))
+                        u16Rows[k*2] |= (0x8000 >> (j*2-1));
+                    else if ((~c0 & ucMask2) && (c1 & ucMask2) && (c0 & ucMask) && (~c1 & ucMask))
+                        u16Rows[k*2] |= (0x8000 >> (j*2));
+                }
+            } // for j
+        } // for k
+        cx = 12;
+    } else {
+        cx = (iFontSize == FONT_8x8) ? 8 : 6;
+        s = (iFontSize == FONT_8x8) ? (uint8_t *)&ucFont[(c-32) * 7] : (uint8_t *)&ucSmallFont[(c-32) * 5];
+        for (k=0; k<8; k++) {
+            for (j=0; j<cx-1; j++) { // last column is blank
+                if (s[j] & (1 << k))
+                    u16Rows[k] |= (0x8000 >> j);
+            }
+        }
+    }
+    for (k=0; k<16; k++) {
+        pRows[k][0] = (uint8_t)(u16Rows[k] >> 8);
+        pRows[k][1] = (uint8_t)u16Rows[k];
+    }
+    return cx;
+} /* lcdGlyphRows() */
+
+//
+// A horizontal strip of the display being composed in RAM
+//
+typedef struct lcd_band_tag {
+    uint16_t *pPixels;
+    int x, y, w, h;
+} LCDBAND;
+
+static void lcdBandRect(LCDBAND *pBand, int x, int y, int w, int h, uint16_t u16Color)
+{
+    int tx, ty, x1, y1;
+    uint16_t *d;
+
+    x1 = x + w; y1 = y + h;
+    if (x < pBand->x) x = pBand->x;
+    if (y < pBand->y) y = pBand->y;
+    if (x1 > pBand->x + pBand->w) x1 = pBand->x + pBand->w;
+    if (y1 > pBand->y + pBand->h) y1 = pBand->y + pBand->h;
+    for (ty=y; ty<y1; ty++) {
+        d = &pBand->pPixels[(ty - pBand->y)*pBand->w + (x - pBand->x)];
+        for (tx=x; tx<x1; tx++)
+            *d++ = u16Color;
+    }
+} /* lcdBandRect() */
+
+//
+// Draw one line of 1-bpp (MSB first) data starting at bit iBitOff
+// 0 bits are only drawn (in the BG color) if bOpaque is true
+//
+static void lcdBandBits(LCDBAND *pBand, int x, int y, const uint8_t *pBits, int iBitOff, int iWidth, uint16_t u16FG, uint16_t u16BG, int bOpaque)
+{
+    int tx, x1;
+    uint16_t *d;
+
+    if (y < pBand->y || y >= pBand->y + pBand->h) return;
+    x1 = x + iWidth;
+    if (x1 > pBand->x + pBand->w) x1 = pBand->x + pBand->w;
+    if (x < pBand->x) { // clip left edge
+        iBitOff += pBand->x - x;
+        x = pBand->x;
+    }
+    d = &pBand->pPixels[(y - pBand->y)*pBand->w + (x - pBand->x)];
+    if (bOpaque) {
+        if (x1 > x)
+            lcdExpand1bpp(pBits, iBitOff, x1 - x, d, u16FG, u16BG);
+        return;
+    }
+    for (tx=x; tx<x1; tx++, iBitOff++, d++) {
+        if (pBits[iBitOff >> 3] & (0x80 >> (iBitOff & 7)))
+            *d = u16FG;
+    }
+} /* lcdBandBits() */
+
+static void lcdBandTile(LCDBAND *pBand, LCDDLITEM *pItem)
+{
+    int ty, x, x1, y1;
+    const uint8_t *s;
+
+    x = pItem->x; x1 = x + pItem->w;
+    if (x < pBand->x) x = pBand->x;
+    if (x1 > pBand->x + pBand->w) x1 = pBand->x + pBand->w;
+    ty = (pItem->y > pBand->y) ? pItem->y : pBand->y;
+    y1 = pItem->y + pItem->h;
+    if (y1 > pBand->y + pBand->h) y1 = pBand->y + pBand->h;
+    for (; ty<y1; ty++) {
+        s = &pItem->pData[(ty - pItem->y)*pItem->iPitch + (x - pItem->x)*2];
+        memcpy(&pBand->pPixels[(ty - pBand->y)*pBand->w + (x - pBand->x)], s, (x1 - x)*2);
+    }
+} /* lcdBandTile() */
+
+static void lcdBandText(LCDBAND *pBand, LCDDLITEM *pItem)
+{
+    uint8_t u8Rows[16][2];
+    int i, ty, cx, cy, x;
+    const char *sz = (const char *)pItem->pData;
+
+    cy = (pItem->u8Font == FONT_12x16) ? 16 : 8;
+    cx = (pItem->u8Font == FONT_12x16) ? 12 : ((pItem->u8Font == FONT_8x8) ? 8 : 6);
+    x = pItem->x;
+    for (i=0; sz[i] && x < pBand->x + pBand->w; i++, x += cx) {
+        if (x + cx <= pBand->x) continue;
+        lcdGlyphRows(pItem->u8Font, (uint8_t)sz[i], u8Rows);
+        for (ty=0; ty<cy; ty++)
+            lcdBandBits(pBand, x, pItem->y + ty, u8Rows[ty], 0, cx, pItem->u16FG, pItem->u16BG, pItem->u16FG != pItem->u16BG);
+    }
+} /* lcdBandText() */
+
+static void lcdBandTextCustom(LCDBAND *pBand, LCDDLITEM *pItem)
+{
+    const GFXfont *pFont = pItem->pFont;
+    const GFXglyph *pGlyph;
+    const char *sz = (const char *)pItem->pData;
+    int i, c, ty, x, dy;
+
+    x = pItem->x + pItem->iPenX;
+    for (i=0; sz[i]; i++) {
+        c = (uint8_t)sz[i];
+        if (c < pFont->first || c > pFont->last) continue;
+        pGlyph = &pFont->glyph[c - pFont->first];
+        dy = pItem->y + pItem->iBaseline + pGlyph->yOffset;
+        for (ty=0; ty<pGlyph->height; ty++) {
+            if (dy + ty < pBand->y) continue;
+            if (dy + ty >= pBand->y + pBand->h) break;
+            lcdBandBits(pBand, x + pGlyph->xOffset, dy + ty, &pFont->bitmap[pGlyph->bitmapOffset],
+                        ty * pGlyph->width, pGlyph->width, pItem->u16FG, 0, 0);
+        }
+        x += pGlyph->xAdvance;
+    }
+} /* lcdBandTextCustom() */
+
+void lcdDLInit(LCDDL *pDL, LCDDLITEM *pItems, int iMax, uint16_t u16Background)
+{
+    pDL->pItems = pItems;
+    pDL->iMax = iMax;
+    pDL->iCount = 0;
+    pDL->u16Background = u16Background;
+    pDL->pfnBackground = NULL;
+    pDL->pBGUser = NULL;
+} /* lcdDLInit() */
+
+//
+// Have the background drawn by a callback (e.g. a gradient or an image
+// already on screen) instead of a solid color; NULL restores the color
+//
+void lcdDLSetBackground(LCDDL *pDL, LCD_BG_CALLBACK pfnBackground, void *pUser)
+{
+    pDL->pfnBackground = pfnBackground;
+    pDL->pBGUser = pUser;
+} /* lcdDLSetBackground() */
+
+void lcdDLClear(LCDDL *pDL)
+{
+    pDL->iCount = 0;
+} /* lcdDLClear() */
+
+static LCDDLITEM *lcdDLNewItem(LCDDL *pDL, int iType, int x, int y, int w, int h)
+{
+    LCDDLITEM *pItem;
+
+    if (pDL == NULL || pDL->iCount >= pDL->iMax || w <= 0 || h <= 0)
+        return NULL;
+    pItem = &pDL->pItems[pDL->iCount++];
+    memset(pItem, 0, sizeof(LCDDLITEM));
+    pItem->u8Type = (uint8_t)iType;
+    pItem->x = (int16_t)x; pItem->y = (int16_t)y;
+    pItem->w = (int16_t)w; pItem->h = (int16_t)h;
+    return pItem;
+} /* lcdDLNewItem() */
+
+int lcdDLAddRect(LCDDL *pDL, int x, int y, int w, int h, uint16_t u16Color)
+{
+    LCDDLITEM *pItem = lcdDLNewItem(pDL, DL_RECT, x, y, w, h);
+
+    if (pItem == NULL) return -1;
+    pItem->u16FG = u16Color;
+    return 0;
+} /* lcdDLAddRect() */
+
+int lcdDLAddTile(LCDDL *pDL, int x, int y, int w, int h, const uint8_t *pTile, int iPitch)
+{
+    LCDDLITEM *pItem;
+
+    if (pTile == NULL) return -1;
+    pItem = lcdDLNewItem(pDL, DL_TILE, x, y, w, h);
+    if (pItem == NULL) return -1;
+    pItem->pData = pTile;
+    pItem->iPitch = (int16_t)iPitch;
+    return 0;
+} /* lcdDLAddTile() */
+
+int lcdDLAddPattern(LCDDL *pDL, int x, int y, int w, int h, const uint8_t *pPattern, int iPitch, uint16_t u16Color)
+{
+    LCDDLITEM *pItem;
+
+    if (pPattern == NULL) return -1;
+    pItem = lcdDLNewItem(pDL, DL_PATTERN, x, y, w, h);
+    if (pItem == NULL) return -1;
+    pItem->pData = pPattern;
+    pItem->iPitch = (int16_t)iPitch;
+    pItem->u16FG = u16Color;
+    return 0;
+} /* lcdDLAddPattern() */
+
+int lcdDLAddText(LCDDL *pDL, int x, int y, const char *szMsg, uint16_t u16FG, uint16_t u16BG, int iFontSize)
+{
+    LCDDLITEM *pItem;
+    int cx;
+
+    if (szMsg == NULL || iFontSize < 0 || iFontSize >= FONT_COUNT) return -1;
+    cx = (iFontSize == FONT_12x16) ? 12 : ((iFontSize == FONT_8x8) ? 8 : 6);
+    pItem = lcdDLNewItem(pDL, DL_TEXT, x, y, cx * (int)strlen(szMsg), (iFontSize == FONT_12x16) ? 16 : 8);
+    if (pItem == NULL) return -1;
+    pItem->pData = (const uint8_t *)szMsg;
+    pItem->u8Font = (uint8_t)iFontSize;
+    pItem->u16FG = u16FG;
+    pItem->u16BG = u16BG;
+    return 0;
+} /* lcdDLAddText() */
+
+//
+// Proportional text; y is the baseline like lcdWriteStringCustom()
+// The bounding box is the union of the glyph boxes
+//
+int lcdDLAddTextCustom(LCDDL *pDL, const GFXfont *pFont, int x, int y, const char *szMsg, uint16_t u16FG)
+{
+    LCDDLITEM *pItem;
+    const GFXglyph *pGlyph;
+    int i, c, tx, minx, miny, maxx, maxy;
+
+    if (pFont == NULL || szMsg == NULL) return -1;
+    minx = miny = 0x7fff; maxx = maxy = -0x7fff;
+    tx = x;
+    for (i=0; szMsg[i]; i++) {
+        c = (uint8_t)szMsg[i];
+        if (c < pFont->first || c > pFont->last) continue;
+        pGlyph = &pFont->glyph[c - pFont->first];
+        if (pGlyph->width && pGlyph->height) {
+            if (tx + pGlyph->xOffset < minx) minx = tx + pGlyph->xOffset;
+            if (tx + pGlyph->xOffset + pGlyph->width > maxx) maxx = tx + pGlyph->xOffset + pGlyph->width;
+            if (y + pGlyph->yOffset < miny) miny = y + pGlyph->yOffset;
+            if (y + pGlyph->yOffset + pGlyph->height > maxy) maxy = y + pGlyph->yOffset + pGlyph->height;
+        }
+        tx += pGlyph->xAdvance;
+    }
+    if (maxx <= minx) return 0; // nothing to draw
+    pItem = lcdDLNewItem(pDL, DL_TEXT_CUSTOM, minx, miny, maxx - minx, maxy - miny);
+    if (pItem == NULL) return -1;
+    pItem->pData = (const uint8_t *)szMsg;
+    pItem->pFont = pFont;
+    pItem->u16FG = u16FG;
+    pItem->iPenX = (int16_t)(x - minx);
+    pItem->iBaseline = (int16_t)(y - miny);
+    return 0;
+} /* lcdDLAddTextCustom() */
+
+//
+// Compose and send part of the display list
+// Each band is built in the free ping-pong buffer while DMA sends the
+// previous one, so the region is updated with one window and no overdraw
+//
+int lcdDLRenderRegion(LCDDL *pDL, int x, int y, int w, int h)
+{
+    LCDBAND band;
+    LCDDLITEM *pItem;
+    int i, j, iBandRows;
+
+    if (pDL == NULL) return -1;
+    if (x < 0) { w += x; x = 0; } // clip to the display
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > iLCDWidth) w = iLCDWidth - x;
+    if (y + h > iLCDHeight) h = iLCDHeight - y;
+    if (w <= 0 || h <= 0) return -1;
+    iBandRows = CACHE_SIZE / (w*2);
+    if (iBandRows > CACHED_LINES)
+        iBandRows = CACHED_LINES;
+    lcdSetPosition(x, y, w, h);
+    band.x = x; band.w = w;
+    for (band.y = y; band.y < y + h; band.y += band.h) {
+        band.h = y + h - band.y;
+        if (band.h > iBandRows)
+            band.h = iBandRows;
+        band.pPixels = (uint16_t *)pCache0; // the other buffer may still be sending
+        if (pDL->pfnBackground) {
+            for (j=0; j<band.h; j++)
+                (*pDL->pfnBackground)(band.x, band.y + j, band.w, &band.pPixels[j * band.w], pDL->pBGUser);
+        } else {
+            lcdBandRect(&band, band.x, band.y, band.w, band.h, pDL->u16Background);
+        }
+        for (i=0; i<pDL->iCount; i++) { // painter's order
+            pItem = &pDL->pItems[i];
+            if (pItem->x >= band.x + band.w || pItem->x + pItem->w <= band.x ||
+                pItem->y >= band.y + band.h || pItem->y + pItem->h <= band.y)
+                continue; // doesn't touch this band
+            switch (pItem->u8Type) {
+            case DL_RECT:
+                lcdBandRect(&band, pItem->x, pItem->y, pItem->w, pItem->h, pItem->u16FG);
+                break;
+            case DL_TILE:
+                lcdBandTile(&band, pItem);
+                break;
+            case DL_PATTERN:
+                for (j=0; j<pItem->h; j++)
+                    lcdBandBits(&band, pItem->x, pItem->y + j, &pItem->pData[j * pItem->iPitch], 0, pItem->w, pItem->u16FG, 0, 0);
+                break;
+            case DL_TEXT:
+                lcdBandText(&band, pItem);
+                break;
+            case DL_TEXT_CUSTOM:
+                lcdBandTextCustom(&band, pItem);
+                break;
+            }
+        } // for each item
+        lcdWritePixels(band.pPixels, band.w * band.h);
+    } // for each band
+    return 0;
+} /* lcdDLRenderRegion() */
+
+int lcdDLRender(LCDDL *pDL)
+{
+    return lcdDLRenderRegion(pDL, 0, 0, iLCDWidth, iLCDHeight);
+} /* lcdDLRender() */
+
+//
+// Cost in SPI bytes of sending a rectangle as its own window
+//
+static uint32_t lcdRectCost(LCDRECT *pRect)
+{
+    return (uint32_t)(pRect->x1 - pRect->x0) * (pRect->y1 - pRect->y0) * 2 + LCD_WINDOW_COST;
+} /* lcdRectCost() */
+
+static void lcdRectUnion(LCDRECT *pDest, LCDRECT *pA, LCDRECT *pB)
+{
+    pDest->x0 = (pA->x0 < pB->x0) ? pA->x0 : pB->x0;
+    pDest->y0 = (pA->y0 < pB->y0) ? pA->y0 : pB->y0;
+    pDest->x1 = (pA->x1 > pB->x1) ? pA->x1 : pB->x1;
+    pDest->y1 = (pA->y1 > pB->y1) ? pA->y1 : pB->y1;
+} /* lcdRectUnion() */
+
+//
+// Merge every pair of dirty rectangles which is cheaper to send as one
+// window than as two (overlapping pixels are counted twice, so overlaps
+// are always merged when the union doesn't add too much clean area)
+// If bForce is set and the list is full, the pair which adds the least
+// cost is merged to make room
+//
+static void lcdDirtyCoalesce(int bForce)
+{
+    LCDRECT r;
+    int i, j, iBestI, iBestJ, bMerged;
+    int32_t iDelta, iBest;
+
+    do {
+        bMerged = 0;
+        for (i=0; i<iDirtyCount && !bMerged; i++) {
+            for (j=i+1; j<iDirtyCount; j++) {
+                lcdRectUnion(&r, &dirtyRects[i], &dirtyRects[j]);
+                if (lcdRectCost(&r) <= lcdRectCost(&dirtyRects[i]) + lcdRectCost(&dirtyRects[j])) {
+                    dirtyRects[i] = r;
+                    dirtyRects[j] = dirtyRects[--iDirtyCount];
+                    bMerged = 1; // start over; the bigger rect may now absorb others
+                    break;
+                }
+            }
+        }
+    } while (bMerged);
+
+    if (bForce && iDirtyCount == LCD_MAX_DIRTY) {
+        iBest = 0x7fffffff; iBestI = 0; iBestJ = 1;
+        for (i=0; i<iDirtyCount; i++) {
+            for (j=i+1; j<iDirtyCount; j++) {
+                lcdRectUnion(&r, &dirtyRects[i], &dirtyRects[j]);
+                iDelta = (int32_t)lcdRectCost(&r) - (int32_t)(lcdRectCost(&dirtyRects[i]) + lcdRectCost(&dirtyRects[j]));
+                if (iDelta < iBest) {
+                    iBest = iDelta; iBestI = i; iBestJ = j;
+                }
+            }
+        }
+        lcdRectUnion(&dirtyRects[iBestI], &dirtyRects[iBestI], &dirtyRects[iBestJ]);
+        dirtyRects[iBestJ] = dirtyRects[--iDirtyCount];
+        lcdDirtyCoalesce(0);
+    }
+} /* lcdDirtyCoalesce() */
+
+//
+// Mark an area of the display as needing to be redrawn by lcdFlush()
+//
+void lcdInvalidate(int x, int y, int w, int h)
+{
+    LCDRECT r;
+
+    if (x < 0) { w += x; x = 0; } // clip to the display
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > iLCDWidth) w = iLCDWidth - x;
+    if (y + h > iLCDHeight) h = iLCDHeight - y;
+    if (w <= 0 || h <= 0) return;
+    r.x0 = x; r.y0 = y; r.x1 = x + w; r.y1 = y + h;
+    lcdDirtyCoalesce(1); // make sure there's a free slot
+    dirtyRects[iDirtyCount++] = r;
+    lcdDirtyCoalesce(0);
+} /* lcdInvalidate() */
+
+void lcdInvalidateAll(void)
+{
+    iDirtyCount = 0;
+    lcdInvalidate(0, 0, iLCDWidth, iLCDHeight);
+} /* lcdInvalidateAll() */
+
+int lcdDirtyCount(void)
+{
+    return iDirtyCount;
+} /* lcdDirtyCount() */
+
+//
+// Redraw only the dirty areas from the display list
+// Returns the number of windows sent
+//
+int lcdFlush(LCDDL *pDL)
+{
+    LCDRECT bound;
+    int i, w, h;
+
+    memset(&flushStats, 0, sizeof(flushStats));
+    flushStats.u32FullBytes = (uint32_t)iLCDWidth * iLCDHeight * 2 + LCD_WINDOW_COST;
+    if (pDL == NULL || iDirtyCount == 0)
+        return 0;
+    lcdDirtyCoalesce(0);
+    bound = dirtyRects[0];
+    for (i=0; i<iDirtyCount; i++) {
+        w = dirtyRects[i].x1 - dirtyRects[i].x0;
+        h = dirtyRects[i].y1 - dirtyRects[i].y0;
+        lcdRectUnion(&bound, &bound, &dirtyRects[i]);
+        lcdDLRenderRegion(pDL, dirtyRects[i].x0, dirtyRects[i].y0, w, h);
+        flushStats.u32Rects++;
+        flushStats.u32Pixels += (uint32_t)w * h;
+        flushStats.u32Bytes += lcdRectCost(&dirtyRects[i]);
+    }
+    flushStats.u32BoundBytes = lcdRectCost(&bound);
+    iDirtyCount = 0;
+    return (int)flushStats.u32Rects;
+} /* lcdFlush() */
+
+void lcdGetFlushStats(LCDFLUSHSTATS *pStats)
+{
+    if (pStats)
+        *pStats = flushStats;
+} /* lcdGetFlushStats() */
+
+//
+// Draw a proportional font string as one block
+// The string is laid out first, then the box from the pen start to the
+// pen end (and from the highest to the lowest glyph pixel) is composed
+// band by band in RAM and sent through a single window. The background
+// comes from pfnBackground if given, otherwise it's usBGColor, so
+// transparent text doesn't need to be drawn one run at a time.
+//
+int lcdWriteStringCustomBatch(GFXfont *pFont, int x, int y, char *szMsg, uint16_t usFGColor, uint16_t usBGColor, LCD_BG_CALLBACK pfnBackground, void *pUser)
+{
+    LCDDLITEM item;
+    LCDDL dl;
+    int i, c, iEnd, x0, x1;
+
+    if (pFont == NULL || szMsg == NULL)
+        return -1;
+    if (x == -1)
+        x = iCursorX;
+    if (y == -1)
+        y = iCursorY;
+    iEnd = x; // find where the pen stops
+    for (i=0; szMsg[i]; i++) {
+        c = (uint8_t)szMsg[i];
+        if (c >= pFont->first && c <= pFont->last)
+            iEnd += pFont->glyph[c - pFont->first].xAdvance;
+    }
+    lcdDLInit(&dl, &item, 1, usBGColor);
+    lcdDLSetBackground(&dl, pfnBackground, pUser);
+    if (lcdDLAddTextCustom(&dl, pFont, x, y, szMsg, usFGColor) != 0 || dl.iCount == 0)
+        return -1; // nothing to draw
+    // widen the glyph box to the whole advance so old text is erased
+    x0 = (item.x < x) ? item.x : x;
+    x1 = (item.x + item.w > iEnd) ? item.x + item.w : iEnd;
+    item.iPenX = (int16_t)(x - x0);
+    item.x = (int16_t)x0;
+    item.w = (int16_t)(x1 - x0);
+    lcdDLRenderRegion(&dl, item.x, item.y, item.w, item.h);
+    iCursorX = iEnd;
+    iCursorY = y;
+    return 0;
+} /* lcdWriteStringCustomBatch() */
+
+//
+// Vertical scrolling (VSCRDEF/VSCRSADD)
+// The controller scrolls along its GRAM rows, which are the logical
+// rows only when MADCTL doesn't exchange rows and columns (MV)
+//
+static void lcdScrollArea(int iTFA, int iVSA, int iBFA)
+{
+    uint8_t ucBuf[6];
+
+    ucBuf[0] = (uint8_t)(iTFA >> 8); ucBuf[1] = (uint8_t)iTFA;
+    ucBuf[2] = (uint8_t)(iVSA >> 8); ucBuf[3] = (uint8_t)iVSA;
+    ucBuf[4] = (uint8_t)(iBFA >> 8); ucBuf[5] = (uint8_t)iBFA;
+    lcdWriteCMD(0x33); // VSCRDEF
+    lcdWriteDATA(ucBuf, 6);
+} /* lcdScrollArea() */
+
+static void lcdScrollStart(int iSSA)
+{
+    uint8_t ucBuf[2];
+
+    ucBuf[0] = (uint8_t)(iSSA >> 8);
+    ucBuf[1] = (uint8_t)iSSA;
+    lcdWriteCMD(0x37); // VSCRSADD
+    lcdWriteDATA(ucBuf, 2);
+} /* lcdScrollStart() */
+
+//
+// Put the scrolling area back to normal when the orientation changes;
+// the console redraws itself from scratch on the next write
+//
+static void lcdConsoleReset(void)
+{
+    if (con.bActive && con.bHWScroll && con.bValid) {
+        lcdScrollArea(0, pPanel->iGRAMHeight, 0);
+        lcdScrollStart(0);
+    }
+    con.bValid = 0;
+} /* lcdConsoleReset() */
+
+static void lcdConsoleSetup(void)
+{
+    int iTop;
+
+    con.iCols = iLCDWidth / con.iCharW;
+    con.iRows = iLCDHeight / con.iCharH;
+    con.iCol = con.iRow = con.iScroll = 0;
+    con.iAreaH = con.iRows * con.iCharH;
+    con.bHWScroll = (pPanel->iGRAMHeight > 0 && !(u8ActiveMADCTL & MADCTL_VFLIP) && con.iRows > 1);
+    if (con.bHWScroll) {
+        con.bYFlip = (u8ActiveMADCTL & MADCTL_YFLIP) != 0;
+        // first GRAM row of the visible area (MY addresses rows from the end)
+        iTop = (con.bYFlip) ? pPanel->iGRAMHeight - (iLCDYOff + iLCDHeight) : iLCDYOff;
+        con.iTFA = (con.bYFlip) ? iTop + iLCDHeight - con.iAreaH : iTop;
+        lcdScrollArea(con.iTFA, con.iAreaH, pPanel->iGRAMHeight - con.iTFA - con.iAreaH);
+        lcdScrollStart(con.iTFA);
+    }
+    lcdFill(con.u16BG);
+    con.bValid = 1;
+} /* lcdConsoleSetup() */
+
+//
+// Use the whole display as a scrolling text console
+// Returns 1 if the controller scrolls it, 0 if new lines wrap back to
+// the top instead. VSCRSADD moves the picture along the GRAM rows, which
+// are only the text rows when MADCTL doesn't exchange rows and columns;
+// every built-in panel starts in landscape (MV set) in ORIENTATION_0/180,
+// so hardware scrolling needs ORIENTATION_90 or ORIENTATION_270
+// The console owns the display; other drawing functions address the
+// scrolled GRAM, not what's on the glass
+//
+int lcdConsoleInit(int iFontSize, uint16_t u16FG, uint16_t u16BG)
+{
+    if (iFontSize < 0 || iFontSize >= FONT_COUNT)
+        return -1;
+    lcdConsoleReset();
+    con.iFont = iFontSize;
+    con.iCharW = (iFontSize == FONT_12x16) ? 12 : ((iFontSize == FONT_8x8) ? 8 : 6);
+    con.iCharH = (iFontSize == FONT_12x16) ? 16 : 8;
+    con.u16FG = u16FG;
+    con.u16BG = u16BG;
+    con.bActive = 1;
+    lcdConsoleSetup();
+    return con.bHWScroll;
+} /* lcdConsoleInit() */
+
+void lcdConsoleClear(void)
+{
+    if (!con.bActive) return;
+    lcdConsoleReset();
+    lcdConsoleSetup();
+} /* lcdConsoleClear() */
+
+//
+// GRAM (logical) y of a text row on the glass
+//
+static int lcdConsoleLineY(int iRow)
+{
+    if (!con.bHWScroll)
+        return iRow * con.iCharH;
+    return (iRow * con.iCharH + con.iScroll) % con.iAreaH;
+} /* lcdConsoleLineY() */
+
+//
+// Move to the start of the next line; at the bottom, the top line is
+// erased and the scrolling area moves up by one text row
+//
+static void lcdConsoleNewLine(void)
+{
+    con.iCol = 0;
+    if (con.iRow < con.iRows - 1) {
+        con.iRow++;
+    } else if (con.bHWScroll) {
+        lcdFillRect(0, lcdConsoleLineY(0), iLCDWidth, con.iCharH, con.u16BG);
+        con.iScroll = (con.iScroll + con.iCharH) % con.iAreaH;
+        if (con.bYFlip)
+            lcdScrollStart(con.iTFA + (con.iAreaH - con.iScroll) % con.iAreaH);
+        else
+            lcdScrollStart(con.iTFA + con.iScroll);
+        return;
+    } else {
+        con.iRow = 0; // no scrolling hardware to use; wrap
+    }
+    lcdFillRect(0, lcdConsoleLineY(con.iRow), iLCDWidth, con.iCharH, con.u16BG);
+} /* lcdConsoleNewLine() */
+
+//
+// Write text at the cursor; handles \n, \r and wraps long lines
+//
+void lcdConsoleWrite(const char *szMsg)
+{
+    char szRun[64];
+    int i;
+
+    if (!con.bActive || szMsg == NULL) return;
+    if (!con.bValid) // orientation changed
+        lcdConsoleSetup();
+    while (*szMsg) {
+        if (*szMsg == '\n') {
+            lcdConsoleNewLine();
+            szMsg++;
+        } else if (*szMsg == '\r') {
+            con.iCol = 0;
+            szMsg++;
+        } else {
+            if (con.iCol >= con.iCols)
+                lcdConsoleNewLine();
+            // draw as much of the line as possible in one call
+            for (i=0; szMsg[i] && szMsg[i] != '\n' && szMsg[i] != '\r' &&
+                      con.iCol + i < con.iCols && i < (int)sizeof(szRun)-1; i++)
+                szRun[i] = szMsg[i];
+            szRun[i] = 0;
+            lcdWriteString(con.iCol * con.iCharW, lcdConsoleLineY(con.iRow), szRun, con.u16FG, con.u16BG, con.iFont);
+            con.iCol += i;
+            szMsg += i;
+        }
+    }
+} /* lcdConsoleWrite() */
+
+//
+// Indexed-color framebuffer
+// While it's enabled, every drawing function renders into pBuffer and
+// the color arguments are palette indices (RGB565 tiles are matched to
+// the nearest palette color). Pixels are packed MSB first, so the first
+// pixel of a 4-bpp row is the upper nibble of the first byte.
+// lcdFBFlush() sends the rows that changed through the palette.
+// The framebuffer covers the display in the orientation active at the
+// time of lcdFBInit(); pBuffer must hold ((width*bpp+7)/8)*height bytes.
+// Pass NULL to go back to drawing directly on the display.
+//
+int lcdFBInit(uint8_t *pBuffer, int iBpp, const uint16_t *pPalette)
+{
+    if (pBuffer == NULL) {
+        pFB = NULL;
+        return 0;
+    }
+    if ((iBpp != 1 && iBpp != 2 && iBpp != 4 && iBpp != 8) || pPalette == NULL ||
+        iLCDHeight > (int)(sizeof(u32FBDirty) * 8))
+        return -1;
+    lcdWaitDMA();
+    pFB = pBuffer;
+    iFBBpp = iBpp;
+    iFBWidth = iLCDWidth;
+    iFBHeight = iLCDHeight;
+    iFBPitch = ((iFBWidth * iBpp) + 7) >> 3;
+    pFBPalette = pPalette;
+    bFBNearestValid = 0;
+    memset(pFB, 0, iFBPitch * iFBHeight);
+    lcdFBInvalidate();
+    return 0;
+} /* lcdFBInit() */
+
+//
+// Use a new (or modified) palette; the next flush resends every row
+// so the screen changes colors without redrawing anything
+//
+void lcdFBSetPalette(const uint16_t *pPalette)
+{
+    if (pPalette == NULL) return;
+    pFBPalette = pPalette;
+    bFBNearestValid = 0; // the entries may have changed in place
+    lcdFBInvalidate();
+} /* lcdFBSetPalette() */
+
+void lcdFBInvalidate(void)
+{
+    memset(u32FBDirty, 0xff, sizeof(u32FBDirty));
+} /* lcdFBInvalidate() */
+
+uint8_t *lcdFBGetBuffer(void)
+{
+    return pFB;
+} /* lcdFBGetBuffer() */
+
+static void lcdFBDirtyRows(int y, int h)
+{
+    for (; h > 0; y++, h--)
+        u32FBDirty[y >> 5] |= (1u << (y & 31));
+} /* lcdFBDirtyRows() */
+
+static void lcdFBPut(int x, int y, uint8_t u8Index)
+{
+    uint8_t *d, u8Mask;
+    int iShift;
+
+    if ((unsigned)x >= (unsigned)iFBWidth || (unsigned)y >= (unsigned)iFBHeight)
+        return;
+    d = &pFB[(y * iFBPitch) + ((x * iFBBpp) >> 3)];
+    iShift = 8 - iFBBpp - ((x * iFBBpp) & 7);
+    u8Mask = (uint8_t)(((1 << iFBBpp) - 1) << iShift);
+    *d = (*d & ~u8Mask) | ((u8Index << iShift) & u8Mask);
+} /* lcdFBPut() */
+
+//
+// Pixels sent to the current window land in the framebuffer,
+// wrapping at the window edges like the controller's write pointer
+//
+static void lcdFBWritePixels(uint16_t *pPixels, int iCount)
+{
+    int iStartY = iFBCurY;
+
+    while (iCount-- > 0) {
+        lcdFBPut(iFBCurX, iFBCurY, (uint8_t)*pPixels++);
+        if (++iFBCurX >= iFBWinX + iFBWinW) {
+            iFBCurX = iFBWinX;
+            if (++iFBCurY >= iFBWinY + iFBWinH) {
+                lcdFBDirtyRows(iStartY, iFBCurY - iStartY);
+                iFBCurY = iStartY = iFBWinY;
+            }
+        }
+    }
+    lcdFBDirtyRows(iStartY, iFBCurY - iStartY + (iFBCurX != iFBWinX));
+} /* lcdFBWritePixels() */
+
+static void lcdFBFillRect(int x, int y, int w, int h, uint16_t u16Index)
+{
+    int tx, ty;
+    uint8_t u8Fill;
+
+    if (x + w > iFBWidth) w = iFBWidth - x;
+    if (y + h > iFBHeight) h = iFBHeight - y;
+    if (w <= 0 || h <= 0) return;
+    u8Fill = (uint8_t)u16Index;
+    if (iFBBpp == 8) {
+        for (ty=y; ty<y+h; ty++)
+            memset(&pFB[(ty * iFBPitch) + x], u8Fill, w);
+    } else {
+        for (ty=y; ty<y+h; ty++)
+            for (tx=x; tx<x+w; tx++)
+                lcdFBPut(tx, ty, u8Fill);
+    }
+    lcdFBDirtyRows(y, h);
+} /* lcdFBFillRect() */
+
+//
+// Closest palette entry to an RGB565 color
+//
+static uint8_t lcdFBNearest(uint16_t u16Color)
+{
+    static uint16_t u16Last;
+    static uint8_t u8Last;
+    int i, iDist, iBest, dr, dg, db;
+
+    if (bFBNearestValid && u16Last == u16Color)
+        return u8Last;
+    iBest = 0x7fffffff;
+    for (i=0; i<(1 << iFBBpp); i++) {
+        dr = (int)(u16Color >> 11) - (pFBPalette[i] >> 11);
+        dg = (int)((u16Color >> 5) & 0x3f) - ((pFBPalette[i] >> 5) & 0x3f);
+        db = (int)(u16Color & 0x1f) - (pFBPalette[i] & 0x1f);
+        iDist = (dr*dr*4) + (dg*dg) + (db*db*4); // 5-bit R/B are worth 2 steps of G
+        if (iDist < iBest) {
+            iBest = iDist;
+            u8Last = (uint8_t)i;
+            if (iDist == 0) break;
+        }
+    }
+    u16Last = u16Color;
+    bFBNearestValid = 1;
+    return u8Last;
+} /* lcdFBNearest() */
+
+static void lcdFBDrawTile(int x, int y, int w, int h, uint8_t *pTile, int iPitch)
+{
+    int tx, ty;
+    uint16_t *s;
+
+    for (ty=0; ty<h; ty++) {
+        s = (uint16_t *)&pTile[ty * iPitch];
+        for (tx=0; tx<w; tx++)
+            lcdFBPut(x + tx, y + ty, lcdFBNearest(s[tx]));
+    }
+    lcdFBDirtyRows(y, h);
+} /* lcdFBDrawTile() */
+
+//
+// Convert one framebuffer row to RGB565 through the palette
+//
+static void lcdFBExpandRow(const uint8_t *s, uint16_t *d, int iWidth)
+{
+    int x;
+    uint8_t uc;
+    const uint16_t *pPal = pFBPalette;
+
+    switch (iFBBpp) {
+    case 1:
+        lcdExpand1bpp(s, 0, iWidth, d, pPal[1], pPal[0]);
+        break;
+    case 2:
+        for (x=0; x<iWidth-3; x+=4) {
+            uc = *s++;
+            d[0] = pPal[uc >> 6]; d[1] = pPal[(uc >> 4) & 3];
+            d[2] = pPal[(uc >> 2) & 3]; d[3] = pPal[uc & 3];
+            d += 4;
+        }
+        for (uc = *s; x<iWidth; x++, uc <<= 2)
+            *d++ = pPal[uc >> 6];
+        break;
+    case 4:
+        for (x=0; x<iWidth-1; x+=2) {
+            uc = *s++;
+            d[0] = pPal[uc >> 4]; d[1] = pPal[uc & 0xf];
+            d += 2;
+        }
+        if (x < iWidth)
+            *d = pPal[*s >> 4];
+        break;
+    case 8:
+        for (x=0; x<iWidth; x++)
+            d[x] = pPal[s[x]];
+        break;
+    }
+} /* lcdFBExpandRow() */
+
+//
+// Send the rows which changed since the last flush
+// Each run of dirty rows is one window; its rows are expanded a band at
+// a time into the free ping-pong buffer while DMA sends the other one
+// Returns the number of rows sent
+//
+int lcdFBFlush(void)
+{
+    int y, y1, j, k, h, iBandRows, iRows = 0;
+    uint16_t *d;
+
+    if (pFB == NULL || iFBWidth != iLCDWidth || iFBHeight != iLCDHeight)
+        return -1; // off, or the orientation changed
+    iBandRows = CACHE_SIZE / (iFBWidth * 2);
+    bFBBypass = 1;
+    for (y=0; y<iFBHeight; y = y1) {
+        if (!(u32FBDirty[y >> 5] & (1u << (y & 31)))) {
+            y1 = y + 1;
+            continue;
+        }
+        for (y1 = y+1; y1 < iFBHeight && (u32FBDirty[y1 >> 5] & (1u << (y1 & 31))); y1++) {};
+        lcdSetPosition(0, y, iFBWidth, y1 - y);
+        for (j=y; j<y1; j += h) {
+            h = (y1 - j < iBandRows) ? y1 - j : iBandRows;
+            d = (uint16_t *)pCache0;
+            for (k=0; k<h; k++)
+                lcdFBExpandRow(&pFB[(j + k) * iFBPitch], &d[k * iFBWidth], iFBWidth);
+            lcdWritePixels(d, iFBWidth * h);
+        }
+        iRows += y1 - y;
+    }
+    bFBBypass = 0;
+    memset(u32FBDirty, 0, sizeof(u32FBDirty));
+    return iRows;
+} /* lcdFBFlush() */
+
+//
+// Background refresh
+// The area is sent in bands of up to CACHED_LINES lines. Each time a band
+// has been sent, the DMA interrupt starts the band which is already
+// waiting in the other buffer and calls the fill hook for the one after
+// it, so a whole frame goes out without the main loop's help.
+// The fill hook and the frame-done callback run in interrupt context.
+//
+static int lcdRefreshFill(int iBuf, int y)
+{
+    int iRows = iRefreshH - y;
+
+    if (iRows > iRefreshBandRows)
+        iRows = iRefreshBandRows;
+    (*pfnRefreshFill)(iRefreshX, iRefreshY + y, iRefreshW, iRows, (uint16_t *)pRefreshBuf[iBuf], pRefreshUser);
+    return iRows;
+} /* lcdRefreshFill() */
+
+static void lcdRefreshNext(void *pUnused)
+{
+    int iRows, iBuf, iNextY;
+
+    (void)pUnused;
+    if (iRefreshSendY >= iRefreshH) { // the last band went out
+        bRefreshActive = 0;
+        u32RefreshFrames++;
+        if (pfnRefreshDone)
+            (*pfnRefreshDone)(pRefreshDoneUser);
+        return;
+    }
+    iBuf = iRefreshSendBuf;
+    iRows = iRefreshH - iRefreshSendY;
+    if (iRows > iRefreshBandRows)
+        iRows = iRefreshBandRows;
+    // update the state before the transfer can complete
+    iNextY = iRefreshSendY + iRows;
+    iRefreshSendY = iNextY;
+    iRefreshSendBuf = iBuf ^ 1;
+    lcdTrackData(iRefreshW * iRows * 2);
+    if (iDMAMode != DMA_MODE_16BIT)
+        lcdSetDMAMode(DMA_MODE_16BIT);
+    lcdDMAStart(pRefreshBuf[iBuf], iRefreshW * iRows, lcdRefreshNext, NULL);
+    // the other buffer has just been sent; prepare the band after this one
+    if (iNextY < iRefreshH)
+        lcdRefreshFill(iBuf ^ 1, iNextY);
+} /* lcdRefreshNext() */
+
+//
+// Start sending the area (x,y,w,h) in the background
+// pfnFill is asked for each band of pixels; pfnFrameDone (optional) is
+// called once the last band has been sent. Other drawing functions wait
+// until the frame is done. Returns 0 for success, -1 if a frame is still
+// in flight or the area is empty
+//
+int lcdRefreshStart(int x, int y, int w, int h, LCD_RENDER_CALLBACK pfnFill, void *pUser, LCD_DMA_CALLBACK pfnFrameDone, void *pDoneUser)
+{
+    int iRows;
+
+    if (bRefreshActive || pfnFill == NULL) return -1;
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > iLCDWidth) w = iLCDWidth - x;
+    if (y + h > iLCDHeight) h = iLCDHeight - y;
+    if (w <= 0 || h <= 0) return -1;
+    lcdSetPosition(x, y, w, h); // also waits for any previous writes
+    lcdWaitFlag(&bDMA, iWaitMode);
+    pfnRefreshFill = pfnFill;
+    pRefreshUser = pUser;
+    pfnRefreshDone = pfnFrameDone;
+    pRefreshDoneUser = pDoneUser;
+    pRefreshBuf[0] = u8Cache0;
+    pRefreshBuf[1] = u8Cache1;
+    iRefreshX = x; iRefreshY = y; iRefreshW = w; iRefreshH = h;
+    iRefreshBandRows = CACHE_SIZE / (w * 2);
+    if (iRefreshBandRows > CACHED_LINES)
+        iRefreshBandRows = CACHED_LINES;
+    iRows = lcdRefreshFill(0, 0);
+    if (iRows < h)
+        lcdRefreshFill(1, iRows);
+    iRefreshSendY = iRows;
+    iRefreshSendBuf = 1;
+    bRefreshActive = 1;
+    lcdTrackData(w * iRows * 2);
+    if (iDMAMode != DMA_MODE_16BIT)
+        lcdSetDMAMode(DMA_MODE_16BIT);
+    lcdDMAStart(pRefreshBuf[0], w * iRows, lcdRefreshNext, NULL);
+    return 0;
+} /* lcdRefreshStart() */
+
+//
+// Returns 1 while a background frame is being sent
+//
+int lcdRefreshBusy(void)
+{
+    return bRefreshActive;
+} /* lcdRefreshBusy() */
+
+//
+// Number of background frames completed since lcdInit()
+//
+uint32_t lcdRefreshFrames(void)
+{
+    return u32RefreshFrames;
+} /* lcdRefreshFrames() */
+
+//
+// Remote drawing protocol
+// lcdRemoteProcess() works through whatever has arrived in the USART1
+// ring buffer (see UART_BeginRx) and returns without waiting for more.
+// Pixel data is read from the ring buffer straight into the free
+// ping-pong buffer and sent from there, so it is copied only once. The
+// pixels of a frame go to the display before its checksum arrives; a bad
+// checksum is counted, but can't take them back. Other drawing calls
+// must wait while lcdRemoteBusy() returns 1 (a pixel frame is half done).
+//
+enum {
+    RS_SYNC = 0,
+    RS_CMD,
+    RS_PLEN,
+    RS_PARAMS,
+    RS_DATA,   // raw pixel bytes (PIXELS, TILE and RLE literals)
+    RS_RLE,    // RLE packet header
+    RS_RUN,    // RLE run color
+    RS_SUM
+};
+static const uint8_t u8RemoteParams[LCD_REMOTE_COUNT] = {0, 8, 4, 10, 8, 8, 9};
+typedef struct lcd_remote_tag {
+    int iState;
+    uint8_t u8Cmd, u8PLen, u8Sum;
+    int iParam;
+    uint8_t u8Params[256];
+    uint32_t u32Pixels; // pixels of the frame still to come
+    uint32_t u32Bytes;  // raw bytes of the current RS_DATA stretch
+    int iFill;          // bytes waiting in pCache0
+    int iRun;           // bytes of the RLE run color seen so far
+    uint8_t u8Run[2];
+    int bDiscard;       // consume the pixels without drawing them
+    int bWindow;        // a LCD_REMOTE_WINDOW has been set
+    uint32_t u32WindowPixels; // w*h of the last LCD_REMOTE_WINDOW (0 = none)
+    uint64_t u64Start;  // SysTick at lcdRemoteResetStats()
+    LCDREMOTESTATS stats;
+} LCDREMOTE;
+static LCDREMOTE rem;
+
+static int lcdRemoteU16(int i)
+{
+    return rem.u8Params[i] | (rem.u8Params[i+1] << 8);
+} /* lcdRemoteU16() */
+
+static int lcdRemoteS16(int i)
+{
+    return (int16_t)lcdRemoteU16(i);
+} /* lcdRemoteS16() */
+
+//
+// Send the whole pixels collected in pCache0
+// An odd byte left over is moved to the start of the next buffer
+//
+static void lcdRemoteFlush(void)
+{
+    int iPixels = rem.iFill >> 1;
+    uint8_t *pOld = pCache0;
+
+    if (iPixels == 0) return;
+    if (!rem.bDiscard) {
+        lcdWritePixels((uint16_t *)pCache0, iPixels); // swaps the buffers for DMA
+        rem.stats.u32Pixels += iPixels;
+    }
+    if (rem.iFill & 1)
+        pCache0[0] = pOld[iPixels * 2];
+    rem.iFill &= 1;
+} /* lcdRemoteFlush() */
+
+static int lcdRemoteOnScreen(int x, int y, int w, int h)
+{
+    return (x >= 0 && y >= 0 && w > 0 && h > 0 && x + w <= iLCDWidth && y + h <= iLCDHeight);
+} /* lcdRemoteOnScreen() */
+
+//
+// The parameters are complete; set up the pixel data, if any
+//
+static void lcdRemoteStart(void)
+{
+    int x, y, w, h;
+
+    rem.bDiscard = 0;
+    rem.iFill = 0;
+    switch (rem.u8Cmd) {
+    case LCD_REMOTE_PIXELS:
+        rem.u32Pixels = lcdRemoteU16(0) | ((uint32_t)lcdRemoteU16(2) << 16);
+        if (rem.u32Pixels > rem.u32WindowPixels || rem.u32Pixels > 0x7fffffff) {
+            // a corrupt count; don't take that many bytes as pixels
+            // (or wrap the byte count) but look for the next frame
+            rem.stats.u32BadCount++;
+            rem.stats.u32Dropped++;
+            rem.iState = RS_SYNC;
+            return;
+        }
+        rem.bDiscard = !rem.bWindow;
+        break;
+    case LCD_REMOTE_TILE:
+    case LCD_REMOTE_TILE_RLE:
+        x = lcdRemoteS16(0); y = lcdRemoteS16(2);
+        w = lcdRemoteS16(4); h = lcdRemoteS16(6);
+        rem.u32Pixels = (w > 0 && h > 0) ? (uint32_t)(w * h) : 0;
+        if (lcdRemoteOnScreen(x, y, w, h)) {
+            lcdSetPosition(x, y, w, h);
+            rem.bWindow = 0; // the tile replaced the remote window
+            rem.u32WindowPixels = 0;
+        } else {
+            rem.bDiscard = 1;
+        }
+        break;
+    default: // no pixel data
+        rem.iState = RS_SUM;
+        return;
+    }
+    if (rem.bDiscard)
+        rem.stats.u32Clipped++;
+    if (rem.u8Cmd == LCD_REMOTE_TILE_RLE) {
+        rem.iState = (rem.u32Pixels) ? RS_RLE : RS_SUM;
+    } else {
+        rem.u32Bytes = rem.u32Pixels * 2;
+        rem.iState = (rem.u32Bytes) ? RS_DATA : RS_SUM;
+    }
+} /* lcdRemoteStart() */
+
+//
+// A frame arrived intact; carry out the commands without pixel data
+//
+static void lcdRemoteExecute(void)
+{
+    int x, y, w, h;
+
+    switch (rem.u8Cmd) {
+    case LCD_REMOTE_WINDOW:
+        x = lcdRemoteS16(0); y = lcdRemoteS16(2);
+        w = lcdRemoteS16(4); h = lcdRemoteS16(6);
+        rem.bWindow = lcdRemoteOnScreen(x, y, w, h);
+        // pixels for a window off the display are still taken (and dropped)
+        rem.u32WindowPixels = (w > 0 && h > 0) ? (uint32_t)(w * h) : 0;
+        if (rem.bWindow)
+            lcdSetPosition(x, y, w, h);
+        else
+            rem.stats.u32Clipped++;
+        break;
+    case LCD_REMOTE_FILL:
+        lcdFillRect(lcdRemoteS16(0), lcdRemoteS16(2), lcdRemoteS16(4), lcdRemoteS16(6), (uint16_t)lcdRemoteU16(8));
+        break;
+    case LCD_REMOTE_TEXT:
+        rem.u8Params[rem.u8PLen] = 0; // the characters follow the fixed part
+        lcdWriteString(lcdRemoteS16(0), lcdRemoteS16(2), (char *)&rem.u8Params[9],
+                       (uint16_t)lcdRemoteU16(5), (uint16_t)lcdRemoteU16(7), rem.u8Params[4]);
+        break;
+    }
+} /* lcdRemoteExecute() */
+
+//
+// Copy raw pixel bytes from the UART to pCache0
+//
+static void lcdRemoteData(int iAvail)
+{
+    int i, iCount = CACHE_SIZE - rem.iFill;
+
+    if ((uint32_t)iCount > rem.u32Bytes) iCount = (int)rem.u32Bytes;
+    if (iCount > iAvail) iCount = iAvail;
+    iCount = UART_ReadBytes(&pCache0[rem.iFill], iCount);
+    for (i=0; i<iCount; i++)
+        rem.u8Sum += pCache0[rem.iFill + i];
+    rem.iFill += iCount;
+    rem.u32Bytes -= iCount;
+    rem.stats.u32Bytes += iCount;
+    if (rem.iFill >= CACHE_SIZE - 1)
+        lcdRemoteFlush();
+    if (rem.u32Bytes == 0) { // end of this stretch
+        if (rem.u8Cmd == LCD_REMOTE_TILE_RLE && rem.u32Pixels) {
+            rem.iState = RS_RLE;
+        } else {
+            lcdRemoteFlush();
+            rem.iState = RS_SUM;
+        }
+    }
+} /* lcdRemoteData() */
+
+//
+// Take one byte of the frame header, an RLE packet or the checksum
+//
+static void lcdRemoteByte(uint8_t c)
+{
+    int i, iCount;
+    uint16_t u16Color, *pu16;
+
+    rem.stats.u32Bytes++;
+    if (rem.iState != RS_SYNC && rem.iState != RS_SUM)
+        rem.u8Sum += c;
+    switch (rem.iState) {
+    case RS_SYNC:
+        if (c == LCD_REMOTE_SYNC) {
+            rem.iState = RS_CMD;
+            rem.u8Sum = 0;
+        } else {
+            rem.stats.u32SyncSkipped++;
+        }
+        break;
+    case RS_CMD:
+        rem.u8Cmd = c;
+        rem.iState = RS_PLEN;
+        break;
+    case RS_PLEN:
+        rem.u8PLen = c;
+        rem.iParam = 0;
+        if (rem.u8Cmd == 0 || rem.u8Cmd >= LCD_REMOTE_COUNT ||
+            (rem.u8Cmd == LCD_REMOTE_TEXT && c < u8RemoteParams[LCD_REMOTE_TEXT]) ||
+            (rem.u8Cmd != LCD_REMOTE_TEXT && c != u8RemoteParams[rem.u8Cmd])) {
+            rem.stats.u32BadCommand++;
+            rem.stats.u32Dropped++;
+            rem.iState = RS_SYNC;
+        } else {
+            rem.iState = RS_PARAMS;
+        }
+        break;
+    case RS_RLE:
+        iCount = (c & 0x7f) + 1;
+        if ((uint32_t)iCount > rem.u32Pixels)
+            iCount = (int)rem.u32Pixels; // the packet overshoots the tile
+        rem.u32Pixels -= iCount;
+        if (c & 0x80) {
+            rem.u32Bytes = iCount; // pixels in the run
+            rem.iRun = 0;
+            rem.iState = RS_RUN;
+        } else {
+            rem.u32Bytes = iCount * 2;
+            rem.iState = RS_DATA;
+        }
+        break;
+    case RS_RUN:
+        rem.u8Run[rem.iRun++] = c;
+        if (rem.iRun < 2) break;
+        u16Color = rem.u8Run[0] | (rem.u8Run[1] << 8);
+        iCount = (int)rem.u32Bytes;
+        while (iCount) { // the runs are expanded straight into pCache0
+            pu16 = (uint16_t *)&pCache0[rem.iFill];
+            i = (CACHE_SIZE - rem.iFill) >> 1;
+            if (i > iCount) i = iCount;
+            iCount -= i;
+            rem.iFill += i * 2;
+            while (i--)
+                *pu16++ = u16Color;
+            if (rem.iFill >= CACHE_SIZE - 1)
+                lcdRemoteFlush();
+        }
+        rem.iState = (rem.u32Pixels) ? RS_RLE : RS_SUM;
+        if (rem.iState == RS_SUM)
+            lcdRemoteFlush();
+        break;
+    case RS_SUM:
+        if (rem.u8Sum == c) {
+            rem.stats.u32Frames++;
+            lcdRemoteExecute();
+        } else {
+            rem.stats.u32BadChecksum++;
+            rem.stats.u32Dropped++;
+        }
+        rem.iState = RS_SYNC;
+        break;
+    }
+} /* lcdRemoteByte() */
+
+//
+// Work through the bytes waiting in the UART ring buffer
+// Returns the number of complete frames handled
+//
+int lcdRemoteProcess(void)
+{
+    int iAvail, iCount;
+    uint32_t u32Frames = rem.stats.u32Frames + rem.stats.u32Dropped;
+
+    while ((iAvail = UART_Available()) > 0) {
+        if (rem.iState == RS_DATA) {
+            lcdRemoteData(iAvail);
+        } else if (rem.iState == RS_PARAMS) {
+            iCount = rem.u8PLen - rem.iParam;
+            if (iCount > iAvail) iCount = iAvail;
+            while (iCount--)
+                lcdRemoteByte(rem.u8Params[rem.iParam++] = (uint8_t)UART_ReadByte());
+            if (rem.iParam == rem.u8PLen)
+                lcdRemoteStart();
+        } else {
+            lcdRemoteByte((uint8_t)UART_ReadByte());
+        }
+    }
+    // Don't keep pixels in the shared buffer between calls
+    if (rem.iState == RS_DATA || rem.iState == RS_RLE || rem.iState == RS_RUN)
+        lcdRemoteFlush();
+    return (int)(rem.stats.u32Frames + rem.stats.u32Dropped - u32Frames);
+} /* lcdRemoteProcess() */
+
+//
+// Returns 1 while a frame with pixel data is only partly received
+//
+int lcdRemoteBusy(void)
+{
+    return (rem.iState == RS_DATA || rem.iState == RS_RLE || rem.iState == RS_RUN);
+} /* lcdRemoteBusy() */
+
+//
+// Forget a partly received frame (e.g. after a timeout of the host)
+//
+void lcdRemoteReset(void)
+{
+    if (rem.iState != RS_SYNC) {
+        lcdRemoteFlush();
+        rem.stats.u32Dropped++;
+    }
+    rem.iState = RS_SYNC;
+    rem.iFill = 0;
+    rem.bWindow = 0;
+    rem.u32WindowPixels = 0;
+} /* lcdRemoteReset() */
+
+void lcdRemoteGetStats(LCDREMOTESTATS *pStats)
+{
+    UARTSTATS us;
+    uint64_t u64Ticks = SysTick_Elapsed(rem.u64Start);
+
+    *pStats = rem.stats;
+    UART_GetStats(&us);
+    pStats->u32UARTLost = us.u32BytesLost;
+    pStats->u32BytesPerSec = 0;
+    if (u64Ticks)
+        pStats->u32BytesPerSec = (uint32_t)(((uint64_t)rem.stats.u32Bytes * SysTick_Hz()) / u64Ticks);
+} /* lcdRemoteGetStats() */
+
+void lcdRemoteResetStats(void)
+{
+    memset(&rem.stats, 0, sizeof(rem.stats));
+    rem.u64Start = SysTick_Read();
+} /* lcdRemoteResetStats() */
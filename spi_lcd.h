@@ -46,6 +46,16 @@ enum {
 // enough memory to hold 16 lines of the display for fast character drawing
 #define CACHE_SIZE (320*CACHED_LINES)
 // memory offset of visible area (80x160 out of 240x320)
+// largest block a single DMA transfer can move (16-bit count register)
+#define DMA_MAX_COUNT 65535
+// number of command/data descriptors the DMA interrupt can work through (power of 2)
+#define LCD_QUEUE_SIZE 16
+// number of dirty rectangles tracked before the cheapest pair is merged
+#define LCD_MAX_DIRTY 8
+// SPI bytes a new window costs (CASET + RASET + RAMWR and CS/DC turnaround)
+#define LCD_WINDOW_COST 16
+// maximum number of glyphs held by the lcdWriteStringCustom() cache
+#define LCD_GLYPH_CACHE_ENTRIES 32
 
 // Proportional font data taken from Adafruit_GFX library
 /// Font data stored PER GLYPH
@@ -66,14 +76,162 @@ typedef struct {
   uint8_t yAdvance; ///< Newline distance (y axis)
 } GFXfont;
 
+//
+// Retained display list; the items are composed one band at a time
+// so every pixel is sent once, no matter how much the items overlap
+// Text strings, tiles and patterns are referenced, not copied
+//
+enum {
+	DL_RECT = 0,
+	DL_TILE,        // RGB565 pixels
+	DL_PATTERN,     // 1-bpp (MSB first); 1 = FG color, 0 = transparent
+	DL_TEXT,        // built-in font (FONT_xxx); FG == BG draws transparent text
+	DL_TEXT_CUSTOM, // GFXfont; only the glyph pixels are drawn
+	DL_COUNT
+};
+
+typedef struct lcd_dl_item_tag {
+	uint8_t u8Type;
+	uint8_t u8Font;   // FONT_xxx of DL_TEXT
+	int16_t x, y, w, h; // bounding box on the display
+	int16_t iPitch;   // bytes per line of a tile or pattern
+	uint16_t u16FG, u16BG;
+	int16_t iPenX, iBaseline; // DL_TEXT_CUSTOM: pen start and baseline relative to the box
+	const uint8_t *pData; // pixels, pattern or text
+	const GFXfont *pFont;
+} LCDDLITEM;
+
+// Fills h lines of w RGB565 pixels for the area starting at (x,y)
+typedef void (*LCD_RENDER_CALLBACK)(int x, int y, int w, int h, uint16_t *pPixels, void *pUser);
+
+// Supplies iWidth background pixels of line y starting at column x
+typedef void (*LCD_BG_CALLBACK)(int x, int y, int iWidth, uint16_t *pPixels, void *pUser);
+
+typedef struct lcd_dl_tag {
+	LCDDLITEM *pItems; // storage supplied by the caller
+	int iCount, iMax;
+	uint16_t u16Background; // color of pixels not covered by any item
+	LCD_BG_CALLBACK pfnBackground; // used instead of u16Background if set
+	void *pBGUser;
+} LCDDL;
+
+// Statistics of the last lcdFlush()
+typedef struct lcd_flush_stats_tag {
+	uint32_t u32Rects;      // windows sent
+	uint32_t u32Pixels;     // pixels sent
+	uint32_t u32Bytes;      // SPI bytes of the update (pixels + window overhead)
+	uint32_t u32BoundBytes; // SPI bytes to redraw the bounding box of all dirty areas
+	uint32_t u32FullBytes;  // SPI bytes to redraw the whole display
+} LCDFLUSHSTATS;
+
+// Counters of the lcdWriteStringCustom() glyph cache
+typedef struct lcd_glyph_cache_stats_tag {
+	uint32_t u32Hits;
+	uint32_t u32Misses;
+	uint32_t u32Evictions;
+	int iEntries;    // glyphs currently cached
+	int iBytesUsed;  // of the buffer given to lcdGlyphCacheInit()
+} LCDGLYPHCACHESTATS;
+
+// Called from the DMA interrupt when a lcdWriteDATAAsync() buffer is free again
+typedef void (*LCD_DMA_CALLBACK)(void *pUser);
+
+// How the driver waits for SPI/DMA transfers to finish
+enum {
+	LCD_WAIT_SPIN = 0, // busy loop (lowest latency)
+	LCD_WAIT_WFI,      // sleep until the next interrupt
+	LCD_WAIT_YIELD,    // call the yield callback until the transfer is done
+	LCD_WAIT_COUNT
+};
+typedef void (*LCD_YIELD_CALLBACK)(void *pUser);
+
+typedef struct lcd_wait_stats_tag {
+	uint64_t u64Ticks; // SysTick ticks spent waiting
+	uint32_t u32Waits; // number of waits which had to block
+} LCDWAITSTATS;
+
+// lcdInitEx() options
+enum {
+	LCD_INIT_FAST = 1,       // datasheet-minimal reset/sleep timing
+	LCD_INIT_NO_HWRESET = 2, // RST isn't wired; use SWRESET instead (fast mode)
+	LCD_INIT_NO_RESET = 4,   // controller kept power and settings; skip both resets (fast mode)
+	LCD_INIT_CLEAR = 8       // clear GRAM before display on (fast mode)
+};
+// Called during the mandatory waits of a fast init with the time left (us)
+// It must not use Delay_xx() or otherwise reprogram SysTick
+typedef void (*LCD_BOOT_CALLBACK)(uint32_t u32WaitUs, void *pUser);
+
+typedef struct lcd_boot_stats_tag {
+	uint32_t u32InitUs;       // duration of lcdInit()/lcdInitEx()
+	uint32_t u32DelayUs;      // part of it spent idle in Delay_Us()
+	uint32_t u32FirstPixelUs; // from the start of init to the first pixel drawn (0 = not yet)
+} LCDBOOTSTATS;
+
 void lcdFill(uint16_t u16Color);
+int lcdFillRect(int x, int y, int w, int h, uint16_t u16Color);
+int lcdRenderRegion(int x, int y, int w, int h, LCD_RENDER_CALLBACK pfnRender, void *pUser);
+// Interrupt-driven refresh of an area; pfnFill runs in the DMA interrupt
+int lcdRefreshStart(int x, int y, int w, int h, LCD_RENDER_CALLBACK pfnFill, void *pUser, LCD_DMA_CALLBACK pfnFrameDone, void *pDoneUser);
+int lcdRefreshBusy(void);
+uint32_t lcdRefreshFrames(void);
+// u32Speed = 0 runs the SPI bus at the panel's rated maximum
 void lcdInit(int iLCDType, uint32_t u32Speed, uint8_t u8CSPin, uint8_t u8DCPin, uint8_t u8RSTPin, uint8_t u8BLPin);
+void lcdInitEx(int iLCDType, uint32_t u32Speed, uint8_t u8CSPin, uint8_t u8DCPin, uint8_t u8RSTPin, uint8_t u8BLPin, int iFlags, LCD_BOOT_CALLBACK pfnBoot, void *pUser);
+void lcdGetBootStats(LCDBOOTSTATS *pStats);
 void lcdWriteCMD(uint8_t ucCMD);
 void lcdWriteDATA(uint8_t *pData, int iLen);
+void lcdWriteDATAAsync(uint8_t *pData, int iLen, LCD_DMA_CALLBACK pfnDone, void *pUser);
+void lcdWritePixels(uint16_t *pPixels, int iCount);
+int lcdDMABusy(void);
+void lcdWaitDMA(void);
+void lcdWaitDMAEx(int iMode);
+int lcdSetWaitMode(int iMode);
+void lcdSetYieldCallback(LCD_YIELD_CALLBACK pfnYield, void *pUser);
+void lcdGetWaitStats(LCDWAITSTATS *pStats);
+void lcdResetWaitStats(void);
+void lcdSetPosition(int x, int y, int w, int h);
+int lcdQueueCMD(uint8_t u8CMD, uint8_t *pParams, int iLen);
+int lcdQueueDATA(uint8_t *pData, int iLen);
+int lcdQueueSetPosition(int x, int y, int w, int h);
+// pixels are native RGB565, like lcdWritePixels()
+int lcdQueueTile(int x, int y, int w, int h, uint16_t *pPixels);
 int lcdWriteString(int x, int y, char *szMsg, uint16_t usFGColor, uint16_t usBGColor, int iFontSize);
 int lcdDrawTile(int x, int y, int iTileWidth, int iTileHeight, unsigned char *pTile, int iPitch);
 int lcdWriteStringCustom(GFXfont *pFont, int x, int y, char *szMsg, uint16_t usFGColor, uint16_t usBGColor, int bBlank);
+int lcdWriteStringCustomBatch(GFXfont *pFont, int x, int y, char *szMsg, uint16_t usFGColor, uint16_t usBGColor, LCD_BG_CALLBACK pfnBackground, void *pUser);
 void lcdOrientation(int iOrientation);
+uint32_t lcdCommandsElided(void);
+void lcdExpand1bpp(const uint8_t *pSrc, int iBitOff, int iCount, uint16_t *pDest, uint16_t u16FG, uint16_t u16BG);
+void spilcdDrawPattern(uint8_t *pPattern, int iSrcPitch, int iDestX, int iDestY, int iCX, int iCY, uint16_t usColor);
+void lcdDLInit(LCDDL *pDL, LCDDLITEM *pItems, int iMax, uint16_t u16Background);
+void lcdDLClear(LCDDL *pDL);
+void lcdDLSetBackground(LCDDL *pDL, LCD_BG_CALLBACK pfnBackground, void *pUser);
+int lcdDLAddRect(LCDDL *pDL, int x, int y, int w, int h, uint16_t u16Color);
+int lcdDLAddTile(LCDDL *pDL, int x, int y, int w, int h, const uint8_t *pTile, int iPitch);
+int lcdDLAddPattern(LCDDL *pDL, int x, int y, int w, int h, const uint8_t *pPattern, int iPitch, uint16_t u16Color);
+int lcdDLAddText(LCDDL *pDL, int x, int y, const char *szMsg, uint16_t u16FG, uint16_t u16BG, int iFontSize);
+int lcdDLAddTextCustom(LCDDL *pDL, const GFXfont *pFont, int x, int y, const char *szMsg, uint16_t u16FG);
+int lcdDLRender(LCDDL *pDL);
+int lcdDLRenderRegion(LCDDL *pDL, int x, int y, int w, int h);
+void lcdInvalidate(int x, int y, int w, int h);
+void lcdInvalidateAll(void);
+int lcdDirtyCount(void);
+int lcdFlush(LCDDL *pDL);
+void lcdGetFlushStats(LCDFLUSHSTATS *pStats);
+// Text console; the controller only scrolls it in the portrait orientations
+// (ORIENTATION_90/270 of the built-in panels), elsewhere it wraps to the top
+// Returns 1 for hardware scrolling, 0 for wrapping, -1 for a bad font
+int lcdConsoleInit(int iFontSize, uint16_t u16FG, uint16_t u16BG);
+void lcdConsoleWrite(const char *szMsg);
+void lcdConsoleClear(void);
+int lcdFBInit(uint8_t *pBuffer, int iBpp, const uint16_t *pPalette);
+void lcdFBSetPalette(const uint16_t *pPalette);
+void lcdFBInvalidate(void);
+uint8_t *lcdFBGetBuffer(void);
+int lcdFBFlush(void);
+void lcdGlyphCacheInit(uint8_t *pBuffer, int iSize);
+void lcdGlyphCacheClear(void);
+void lcdGetGlyphCacheStats(LCDGLYPHCACHESTATS *pStats);
 
 #define COLOR_BLACK 0
 #define COLOR_WHITE 0xffff
@@ -96,4 +254,46 @@ enum {
 	FONT_COUNT
 };
 
+//
+// Remote drawing protocol (bytes arriving on USART1)
+// Frame: LCD_REMOTE_SYNC, command, parameter length (n), n parameter
+// bytes, pixel data (only for the pixel commands; its size follows from
+// the parameters), checksum (sum of every byte after the sync, mod 256)
+// Coordinates, sizes, colors and pixels are 16-bit little-endian;
+// colors and pixels are RGB565
+//
+#define LCD_REMOTE_SYNC 0xa5
+enum {
+	LCD_REMOTE_WINDOW = 1, // x,y,w,h: lcdSetPosition()
+	LCD_REMOTE_PIXELS,     // 32-bit count (at most the window's w*h), then
+	                       // count pixels into the window
+	LCD_REMOTE_FILL,       // x,y,w,h,color
+	LCD_REMOTE_TILE,       // x,y,w,h, then w*h pixels
+	LCD_REMOTE_TILE_RLE,   // x,y,w,h, then packets until w*h pixels are done:
+	                       // 0x00-0x7f = 1-128 literal pixels follow,
+	                       // 0x80-0xff = 1-128 copies of the next pixel
+	LCD_REMOTE_TEXT,       // x,y,font,fg,bg, then the characters
+	LCD_REMOTE_COUNT
+};
+
+typedef struct lcd_remote_stats_tag {
+	uint32_t u32Bytes;        // bytes taken from the UART
+	uint32_t u32Frames;       // frames received intact
+	uint32_t u32Dropped;      // frames rejected for any of the reasons below
+	uint32_t u32BadChecksum;
+	uint32_t u32BadCommand;   // unknown command or wrong parameter length
+	uint32_t u32BadCount;     // PIXELS counts larger than the remote window
+	uint32_t u32Clipped;      // pixel frames not (fully) on the display; not drawn
+	uint32_t u32SyncSkipped;  // bytes skipped while looking for a frame start
+	uint32_t u32UARTLost;     // bytes the UART ring buffer overwrote
+	uint32_t u32Pixels;       // pixels sent to the display
+	uint32_t u32BytesPerSec;  // since lcdRemoteResetStats()
+} LCDREMOTESTATS;
+
+int lcdRemoteProcess(void);
+int lcdRemoteBusy(void);
+void lcdRemoteReset(void);
+void lcdRemoteGetStats(LCDREMOTESTATS *pStats);
+void lcdRemoteResetStats(void);
+
 #endif /* USER_SPI_LCD_H_ */